@@ -0,0 +1,202 @@
+#include "adaptive.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+AdaptiveResolution::AdaptiveResolution(float width, float height, int count)
+    : count(count), active(count), rest(count, 0), pinned(count, 0),
+      children(static_cast<size_t>(count) * ADAPTIVE_MAX_MERGE, -1), childCount(count, 0),
+      offsets(count, 2), anchor(count, 2), previous(count, 2),
+      mergeGrid(width, height, ADAPTIVE_MERGE_CELL, false),
+      regionSize(ADAPTIVE_REGION_SIZE)
+{
+    regionsX = std::max(1, static_cast<int>(std::ceil(width / regionSize)));
+    regionsY = std::max(1, static_cast<int>(std::ceil(height / regionSize)));
+    regionLimit.assign(regionsX * regionsY, ADAPTIVE_MAX_MERGE);
+}
+
+void AdaptiveResolution::pin(int first, int n) {
+    for (int i = first; i < first + n && i < count; ++i) pinned[i] = 1;
+}
+
+void AdaptiveResolution::setRegionLimit(float x0, float y0, float x1, float y1, int limit) {
+    int rx0 = std::clamp(static_cast<int>(x0 / regionSize), 0, regionsX - 1);
+    int ry0 = std::clamp(static_cast<int>(y0 / regionSize), 0, regionsY - 1);
+    int rx1 = std::clamp(static_cast<int>(x1 / regionSize), 0, regionsX - 1);
+    int ry1 = std::clamp(static_cast<int>(y1 / regionSize), 0, regionsY - 1);
+    limit = std::clamp(limit, 1, ADAPTIVE_MAX_MERGE);
+    for (int ry = ry0; ry <= ry1; ++ry) {
+        for (int rx = rx0; rx <= rx1; ++rx) regionLimit[ry * regionsX + rx] = limit;
+    }
+}
+
+void AdaptiveResolution::disturb(float x, float y, float radius) {
+    disturbances.insert(disturbances.end(), { x, y, radius });
+}
+
+int AdaptiveResolution::limitAt(double x, double y) const {
+    int rx = std::clamp(static_cast<int>(x / regionSize), 0, regionsX - 1);
+    int ry = std::clamp(static_cast<int>(y / regionSize), 0, regionsY - 1);
+    return regionLimit[ry * regionsX + rx];
+}
+
+bool AdaptiveResolution::isDisturbed(double x, double y) const {
+    for (size_t k = 0; k < disturbances.size(); k += 3) {
+        double dx = x - disturbances[k], dy = y - disturbances[k + 1];
+        if (dx * dx + dy * dy < disturbances[k + 2] * disturbances[k + 2]) return true;
+    }
+    return false;
+}
+
+// The first particle of the group becomes the merged one, at the centre of mass
+// with the mean velocity; the rest are parked where they are.
+void AdaptiveResolution::merge(const std::vector<int> &members, double *x, double *v, double *a,
+                               Particle **particles) {
+    int parent = members[0];
+    double cx = 0.0, cy = 0.0, vx = 0.0, vy = 0.0;
+    for (int i : members) {
+        cx += x[2 * i + X];
+        cy += x[2 * i + Y];
+        vx += v[2 * i + X];
+        vy += v[2 * i + Y];
+    }
+    double m = static_cast<double>(members.size());
+    cx /= m; cy /= m; vx /= m; vy /= m;
+
+    for (int i : members) {
+        offsets(i, X) = x[2 * i + X] - cx;
+        offsets(i, Y) = x[2 * i + Y] - cy;
+        if (i == parent) continue;
+        children[parent * ADAPTIVE_MAX_MERGE + childCount[parent]++] = i;
+        particles[i]->active = false;
+        v[2 * i + X] = v[2 * i + Y] = 0.0;
+        a[2 * i + X] = a[2 * i + Y] = 0.0;
+    }
+    x[2 * parent + X] = anchor(parent, X) = cx;
+    x[2 * parent + Y] = anchor(parent, Y) = cy;
+    v[2 * parent + X] = vx;
+    v[2 * parent + Y] = vy;
+    particles[parent]->mass = static_cast<float>(m);
+    particles[parent]->setRadius(RADIUS * std::sqrt(static_cast<float>(m)));
+    active -= static_cast<int>(members.size()) - 1;
+}
+
+// Put every particle of a merged one back at its offset, all moving with it.
+void AdaptiveResolution::split(int parent, double *x, double *v, double *a, Particle **particles, double gravity) {
+    double cx = x[2 * parent + X], cy = x[2 * parent + Y];
+    double vx = v[2 * parent + X], vy = v[2 * parent + Y];
+    for (int k = 0; k <= childCount[parent]; ++k) {
+        int i = k == 0 ? parent : children[parent * ADAPTIVE_MAX_MERGE + k - 1];
+        x[2 * i + X] = cx + offsets(i, X);
+        x[2 * i + Y] = cy + offsets(i, Y);
+        v[2 * i + X] = vx;
+        v[2 * i + Y] = vy;
+        a[2 * i + X] = 0.0;
+        a[2 * i + Y] = gravity;
+        previous(i, X) = vx;
+        previous(i, Y) = vy;
+        anchor(i, X) = x[2 * i + X];
+        anchor(i, Y) = x[2 * i + Y];
+        rest[i] = 0;
+        particles[i]->active = true;
+        particles[i]->mass = 1.0f;
+        particles[i]->setRadius(RADIUS);
+        particles[i]->syncShape();
+    }
+    active += childCount[parent];
+    childCount[parent] = 0;
+}
+
+void AdaptiveResolution::update(matrix &positions, matrix &velocities, matrix &accelerations,
+                                Particle **particles, double gravity) {
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+    double *a = accelerations.data.data();
+    const double drift2 = restDistance * restDistance;
+    const double split2 = splitSpeed * splitSpeed;
+    const double impact2 = impactSpeed * impactSpeed;
+
+    // Contact jitter keeps the speed of a particle in a pile well above zero, so
+    // resting is judged by how far it wanders from where it came to rest.
+    for (int i = 0; i < count; ++i) {
+        if (!particles[i]->active) continue;
+        double vx = v[2 * i + X], vy = v[2 * i + Y];
+        double jx = vx - previous(i, X), jy = vy - previous(i, Y);
+        previous(i, X) = vx;
+        previous(i, Y) = vy;
+        double dx = x[2 * i + X] - anchor(i, X), dy = x[2 * i + Y] - anchor(i, Y);
+        if (dx * dx + dy * dy > drift2) {
+            anchor(i, X) = x[2 * i + X];
+            anchor(i, Y) = x[2 * i + Y];
+            rest[i] = 0;
+        } else {
+            rest[i]++;
+        }
+
+        if (childCount[i] > 0 &&
+            (rest[i] == 0 || vx * vx + vy * vy > split2 || jx * jx + jy * jy > impact2 ||
+             childCount[i] + 1 > limitAt(x[2 * i + X], x[2 * i + Y]) ||
+             isDisturbed(x[2 * i + X], x[2 * i + Y]))) {
+            split(i, x, v, a, particles, gravity);
+        }
+    }
+
+    // Merge resting base particles that share a small cell, as many at a time as
+    // the region allows.
+    mergeGrid.build(positions);
+    for (int c = 0; c < mergeGrid.numCells(); ++c) {
+        int start = mergeGrid.cellStart[c], end = mergeGrid.cellStart[c + 1];
+        if (end - start < 2) continue;
+        group.clear();
+        for (int k = start; k < end; ++k) {
+            int i = mergeGrid.cellParticles[k];
+            if (particles[i]->active && !pinned[i] && childCount[i] == 0 && rest[i] >= restFrames &&
+                !isDisturbed(x[2 * i + X], x[2 * i + Y])) {
+                group.push_back(i);
+            }
+        }
+        if (group.size() < 2) continue;
+        size_t limit = static_cast<size_t>(limitAt(x[2 * group[0] + X], x[2 * group[0] + Y]));
+        if (limit < 2) continue;
+        for (size_t first = 0; first + 1 < group.size(); first += limit) {
+            size_t last = std::min(group.size(), first + limit);
+            std::vector<int> members(group.begin() + first, group.begin() + last);
+            if (members.size() >= 2) merge(members, x, v, a, particles);
+        }
+    }
+    disturbances.clear();
+}
+
+void AdaptiveResolution::permute(const std::vector<int> &order, Particle **particles) {
+    std::vector<int> newIndex(count);
+    for (int k = 0; k < count; ++k) newIndex[order[k]] = k;
+
+    std::vector<int> oldRest(rest), oldCount(childCount), oldChildren(children);
+    std::vector<char> oldPinned(pinned);
+    std::vector<float> oldMass(count), oldRadius(count);
+    std::vector<char> oldActive(count);
+    for (int i = 0; i < count; ++i) {
+        oldMass[i] = particles[i]->mass;
+        oldRadius[i] = particles[i]->radius;
+        oldActive[i] = particles[i]->active;
+    }
+
+    for (int k = 0; k < count; ++k) {
+        int i = order[k];
+        rest[k] = oldRest[i];
+        pinned[k] = oldPinned[i];
+        childCount[k] = oldCount[i];
+        for (int c = 0; c < oldCount[i]; ++c) {
+            children[k * ADAPTIVE_MAX_MERGE + c] = newIndex[oldChildren[i * ADAPTIVE_MAX_MERGE + c]];
+        }
+        particles[k]->mass = oldMass[i];
+        particles[k]->active = oldActive[i];
+        if (particles[k]->radius != oldRadius[i]) particles[k]->setRadius(oldRadius[i]);
+    }
+    offsets.permuteRows(order);
+    anchor.permuteRows(order);
+    previous.permuteRows(order);
+}
@@ -0,0 +1,74 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "particle.h"
+#include "defs.h"
+
+// Adaptive particle resolution for the collision mode. Particles that have
+// stayed put for a while are merged, a few per small cell, into one particle of
+// their total mass and momentum (radius grows with the area). The merged-away
+// particles are parked inactive and remember their offset from the merged
+// particle, which splits back into them when it wanders off, is hit, or is disturbed
+// (e.g. by the mouse). Each coarse region has its own limit on how many
+// particles may merge into one (1 keeps it at full resolution).
+class AdaptiveResolution {
+public:
+    AdaptiveResolution(float width, float height, int count);
+
+    float restDistance = ADAPTIVE_REST_DISTANCE; // a particle staying this close to one spot is resting
+    int restFrames = ADAPTIVE_REST_FRAMES;       // resting this long before merging
+    float splitSpeed = ADAPTIVE_SPLIT_SPEED;     // merged particles faster than this split
+    float impactSpeed = ADAPTIVE_IMPACT_SPEED;   // ... or whose velocity jumps by this in a frame
+
+    // Keep [first, first + count) at full resolution (bonded or clustered particles).
+    void pin(int first, int count);
+
+    // Largest merge of the regions overlapping the rectangle.
+    void setRegionLimit(float x0, float y0, float x1, float y1, int limit);
+
+    // Split merged particles within radius of (x, y) at the next update and keep
+    // the area from merging. Cleared by update().
+    void disturb(float x, float y, float radius);
+
+    // Split what has been disturbed, then merge what has been resting. Active
+    // particles are those of the particles array with active set.
+    void update(matrix &positions, matrix &velocities, matrix &accelerations, Particle **particles, double gravity);
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k]; moves the per-particle state of the Particle objects too.
+    void permute(const std::vector<int> &order, Particle **particles);
+
+    int activeCount() const { return active; }
+
+private:
+    int limitAt(double x, double y) const;
+    bool isDisturbed(double x, double y) const;
+    void merge(const std::vector<int> &group, double *x, double *v, double *a, Particle **particles);
+    void split(int parent, double *x, double *v, double *a, Particle **particles, double gravity);
+
+    int count;
+    int active;
+
+    std::vector<int> rest;       // frames spent resting
+    std::vector<char> pinned;
+    // Particles merged into particle i: children[i * ADAPTIVE_MAX_MERGE ..] of childCount[i].
+    std::vector<int> children;
+    std::vector<int> childCount;
+    matrix offsets;              // offset from the merged particle while merged
+    matrix anchor;               // where the current rest started
+    matrix previous;             // velocities at the last update
+
+    CellGrid mergeGrid;
+    std::vector<int> group;
+
+    float regionSize;
+    int regionsX, regionsY;
+    std::vector<int> regionLimit;
+
+    std::vector<float> disturbances;  // x, y, radius
+};
+
+#endif // ADAPTIVE_H
@@ -0,0 +1,286 @@
+#include "analysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#define X 0
+#define Y 1
+
+void Snapshot::capture(long frame, double time, const matrix &positions, const matrix &velocities, Particle **particles) {
+    this->frame = frame;
+    this->time = time;
+    this->positions.copy(positions);
+    this->velocities.copy(velocities);
+    active.resize(positions.rows);
+    mass.resize(positions.rows);
+    radius.resize(positions.rows);
+    for (int i = 0; i < positions.rows; ++i) {
+        active[i] = particles[i]->active;
+        mass[i] = particles[i]->mass;
+        radius[i] = particles[i]->radius;
+    }
+}
+
+AnalysisScheduler::AnalysisScheduler(double budget) : budget(budget) {}
+
+void AnalysisScheduler::add(AnalysisJob &job, int interval) {
+    if (interval <= 0) {
+        throw std::invalid_argument("Analysis interval must be positive");
+    }
+    entries.push_back({ &job, interval, false, nullptr, 0.0 });
+}
+
+std::shared_ptr<Snapshot> AnalysisScheduler::freeSnapshot() {
+    for (auto &s : snapshots) {
+        if (s.use_count() == 1) return s;
+    }
+    snapshots.push_back(std::make_shared<Snapshot>());
+    return snapshots.back();
+}
+
+void AnalysisScheduler::frame(long frame, double time, const matrix &positions, const matrix &velocities, Particle **particles) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+    std::shared_ptr<Snapshot> taken;
+    for (Entry &e : entries) {
+        if (frame % e.interval != 0) continue;
+        if (e.running) {
+            skippedCount++;
+            continue;
+        }
+        if (!taken) {
+            taken = freeSnapshot();
+            taken->capture(frame, time, positions, velocities, particles);
+        }
+        e.snapshot = taken;
+        e.running = true;
+        e.job->begin(*taken);
+    }
+
+    // Resume the running jobs in turn, starting after the last one resumed, so
+    // a long job cannot starve the others.
+    size_t count = entries.size();
+    for (bool first = true; count > 0; first = false) {
+        size_t k = 0;
+        while (k < count && !entries[(next + k) % count].running) ++k;
+        if (k == count) break;
+        Entry &e = entries[(next + k) % count];
+        double before = elapsed();
+        if (!first && before + e.chunkTime > budget) break;
+        bool complete = e.job->resume();
+        e.chunkTime += 0.25 * (elapsed() - before - e.chunkTime);
+        if (complete) {
+            e.running = false;
+            e.snapshot.reset();
+        }
+        next = (next + k + 1) % count;
+    }
+
+    used = elapsed();
+    if (used > budget) overrunCount++;
+}
+
+// Wavenumbers of S(k) per chunk; each costs a Bessel function per bin.
+static const int WAVENUMBERS_PER_CHUNK = 4;
+
+StructureJob::StructureJob(PairStructure &structure, Diagnostics &diagnostics, const std::vector<double> &k, int writeInterval, int slices)
+    : structure(structure), diagnostics(diagnostics), k(k), sk(k.size()), writeInterval(writeInterval), slices(slices)
+{
+}
+
+void StructureJob::begin(const Snapshot &snapshot) {
+    this->snapshot = &snapshot;
+    phase = 0;
+    done = 0;
+}
+
+// Phases: copy the sample, its slices, close it and write g(r), then S(k).
+bool StructureJob::resume() {
+    if (phase == 0) {
+        structure.beginSample(snapshot->positions, snapshot->active.data());
+    } else if (phase <= slices) {
+        structure.runSlice(phase - 1, slices);
+    } else if (phase == slices + 1) {
+        structure.endSample();
+        if (structure.samples() % writeInterval != 0) return true;
+        diagnostics.writeSeries(snapshot->frame, "g", structure.radii(), structure.rdf());
+    } else {
+        int count = static_cast<int>(k.size());
+        int end = std::min(count, done + WAVENUMBERS_PER_CHUNK);
+        structure.structureFactor(k, done, end, sk);
+        done = end;
+        if (done < count) return false;
+        diagnostics.writeSeries(snapshot->frame, "S", k, sk);
+        return true;
+    }
+    phase++;
+    return false;
+}
+
+DensityFieldJob::DensityFieldJob(float width, float height, float cellSize, int chunk, Diagnostics &diagnostics)
+    : nx(std::max(1, static_cast<int>(std::ceil(width / cellSize)))),
+      ny(std::max(1, static_cast<int>(std::ceil(height / cellSize)))),
+      cellSize(cellSize), chunk(chunk), diagnostics(diagnostics),
+      count(nx * ny), sumX(nx * ny), sumY(nx * ny), rho(nx * ny), ux(nx * ny), uy(nx * ny)
+{
+}
+
+void DensityFieldJob::begin(const Snapshot &snapshot) {
+    this->snapshot = &snapshot;
+    phase = 0;
+    done = 0;
+    std::fill(count.begin(), count.end(), 0.0);
+    std::fill(sumX.begin(), sumX.end(), 0.0);
+    std::fill(sumY.begin(), sumY.end(), 0.0);
+}
+
+// Field cells written per chunk.
+static const int CELLS_PER_WRITE = 1024;
+
+// Phases: bin the particles a chunk at a time and average, then write the
+// fields a piece at a time.
+bool DensityFieldJob::resume() {
+    int cells = nx * ny;
+    if (phase == 0) {
+        const double *x = snapshot->positions.data.data();
+        const double *v = snapshot->velocities.data.data();
+        int rows = snapshot->positions.rows;
+        int end = std::min(rows, done + chunk);
+        for (int i = done; i < end; ++i) {
+            if (!snapshot->active[i]) continue;
+            int cx = std::min(nx - 1, std::max(0, static_cast<int>(x[2 * i + X] / cellSize)));
+            int cy = std::min(ny - 1, std::max(0, static_cast<int>(x[2 * i + Y] / cellSize)));
+            int c = cy * nx + cx;
+            count[c] += 1.0;
+            sumX[c] += v[2 * i + X];
+            sumY[c] += v[2 * i + Y];
+        }
+        done = end;
+        if (done < rows) return false;
+
+        double area = static_cast<double>(cellSize) * cellSize;
+        for (int c = 0; c < cells; ++c) {
+            rho[c] = count[c] / area;
+            ux[c] = count[c] > 0.0 ? sumX[c] / count[c] : 0.0;
+            uy[c] = count[c] > 0.0 ? sumY[c] / count[c] : 0.0;
+        }
+        index.resize(cells);
+        for (int c = 0; c < cells; ++c) index[c] = c;
+        done = 0;
+        phase++;
+        return false;
+    }
+
+    static const char *names[3] = { "density", "velocity_x", "velocity_y" };
+    const std::vector<double> *fields[3] = { &rho, &ux, &uy };
+    int end = std::min(cells, done + CELLS_PER_WRITE);
+    diagnostics.writeSeries(snapshot->frame, names[phase - 1], index, *fields[phase - 1], done, end);
+    done = end;
+    if (done < cells) return false;
+    done = 0;
+    return ++phase == 4;
+}
+
+CheckpointJob::CheckpointJob(const std::string &path, int chunk) : path(path), chunk(chunk) {}
+
+CheckpointJob::~CheckpointJob() {
+    if (file) std::fclose(file);
+}
+
+void CheckpointJob::begin(const Snapshot &snapshot) {
+    this->snapshot = &snapshot;
+    phase = 0;
+    done = 0;
+}
+
+// Phases: open and write the header, positions, velocities, activity, then
+// close and move into place.
+bool CheckpointJob::resume() {
+    int rows = snapshot->positions.rows;
+    std::string temp = path + ".tmp";
+    switch (phase) {
+    case 0:
+        if (file) std::fclose(file);
+        file = std::fopen(temp.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Cannot open checkpoint file " + temp);
+        }
+        std::fprintf(file, "PCHK1 %d %ld %.17g\n", rows, snapshot->frame, snapshot->time);
+        phase++;
+        return false;
+    case 1:
+    case 2: {
+        const matrix &m = phase == 1 ? snapshot->positions : snapshot->velocities;
+        int end = std::min(rows, done + chunk);
+        std::fwrite(m.data.data() + 2 * done, sizeof(double), 2 * (end - done), file);
+        done = end;
+        if (done == rows) {
+            done = 0;
+            phase++;
+        }
+        return false;
+    }
+    default:
+        std::fwrite(snapshot->active.data(), 1, rows, file);
+        bool failed = std::ferror(file) != 0;
+        failed |= std::fclose(file) != 0;
+        file = nullptr;
+        // rename() does not replace an existing file everywhere.
+        std::remove(path.c_str());
+        if (failed || std::rename(temp.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Cannot write checkpoint file " + path);
+        }
+        return true;
+    }
+}
+
+RecordJob::RecordJob(TrajectoryWriter &writer, int chunk) : writer(writer), chunk(chunk) {}
+
+void RecordJob::begin(const Snapshot &snapshot) {
+    this->snapshot = &snapshot;
+    rows = writer.storageIndex();
+    phase = 0;
+    done = 0;
+}
+
+// Phases: the frame header, then positions, velocities, mass, radius and
+// activity gathered into identity order, then the padding.
+bool RecordJob::resume() {
+    int count = writer.particles();
+    if (phase == 0) {
+        TrajectoryFrameHeader header{ snapshot->frame, snapshot->time };
+        writer.write(&header, sizeof(header));
+        phase++;
+        return false;
+    }
+    if (phase == 6) {
+        static const char zeros[8] = {};
+        std::size_t written = sizeof(TrajectoryFrameHeader) + 4 * count * sizeof(double) + 2 * count * sizeof(float) + count;
+        writer.write(zeros, trajectoryFrameBytes(count) - written);
+        return true;
+    }
+
+    static const std::size_t rowBytes[5] = { 2 * sizeof(double), 2 * sizeof(double), sizeof(float), sizeof(float), 1 };
+    const char *source[5] = {
+        reinterpret_cast<const char *>(snapshot->positions.data.data()),
+        reinterpret_cast<const char *>(snapshot->velocities.data.data()),
+        reinterpret_cast<const char *>(snapshot->mass.data()),
+        reinterpret_cast<const char *>(snapshot->radius.data()),
+        snapshot->active.data(),
+    };
+    std::size_t bytes = rowBytes[phase - 1];
+    const char *from = source[phase - 1];
+    int end = std::min(count, done + chunk);
+    buffer.resize((end - done) * bytes);
+    for (int r = done; r < end; ++r) std::memcpy(&buffer[(r - done) * bytes], from + rows[r] * bytes, bytes);
+    writer.write(buffer.data(), buffer.size());
+    done = end;
+    if (done == count) {
+        done = 0;
+        phase++;
+    }
+    return false;
+}
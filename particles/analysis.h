@@ -0,0 +1,185 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "matrix.h"
+#include "particle.h"
+#include "structure.h"
+#include "diagnostics.h"
+#include "trajectory.h"
+
+// Heavy analyses spread over frames. A job is a coroutine written by hand: each
+// resume() does one bounded chunk of work and returns whether the run is done,
+// keeping its place in its own members. The scheduler starts each job's runs at
+// its interval on a snapshot of the simulation taken that frame (shared by the
+// jobs starting together), and at the end of each frame resumes the running jobs
+// in turn while the next chunk, going by the running average of that job's
+// chunks, fits in what is left of the frame's budget. It runs on the frame thread once the
+// step is over, so the chunks may use the thread pool, which is idle then.
+//
+// A run that is still going when its next start is due skips that start instead
+// of piling up, so a job slower than its interval only samples less often.
+
+// The simulation at one frame, copied once for the runs reading it.
+struct Snapshot {
+    long frame = 0;
+    double time = 0.0;
+    matrix positions{0, 2};
+    matrix velocities{0, 2};
+    std::vector<char> active;
+    std::vector<float> mass, radius;
+
+    void capture(long frame, double time, const matrix &positions, const matrix &velocities, Particle **particles);
+};
+
+class AnalysisJob {
+public:
+    virtual ~AnalysisJob() = default;
+    virtual const char *name() const = 0;
+    // Start a run over the snapshot, which stays unchanged until the run is done.
+    virtual void begin(const Snapshot &snapshot) = 0;
+    // Do the next chunk of the run; true once it is complete.
+    virtual bool resume() = 0;
+};
+
+class AnalysisScheduler {
+public:
+    // budget: seconds per frame for the chunks; one chunk always runs if any
+    // job has work, so every run finishes eventually.
+    explicit AnalysisScheduler(double budget);
+
+    // Start a run of job every interval frames.
+    void add(AnalysisJob &job, int interval);
+
+    // Once per frame after the step: start the runs that are due, then resume
+    // the running jobs within the budget.
+    void frame(long frame, double time, const matrix &positions, const matrix &velocities, Particle **particles);
+
+    double budget;
+
+    // Seconds the chunks took in the last frame.
+    double lastFrameTime() const { return used; }
+    // Frames whose chunks ran past the budget, and starts skipped because the
+    // previous run was still going.
+    long overruns() const { return overrunCount; }
+    long skipped() const { return skippedCount; }
+
+private:
+    struct Entry {
+        AnalysisJob *job;
+        int interval;
+        bool running = false;
+        std::shared_ptr<Snapshot> snapshot;
+        double chunkTime = 0.0;    // running average of the job's chunks, seconds
+    };
+
+    std::shared_ptr<Snapshot> freeSnapshot();
+
+    std::vector<Entry> entries;
+    std::vector<std::shared_ptr<Snapshot>> snapshots;   // reused once no run holds them
+    size_t next = 0;                                    // round-robin position
+    double used = 0.0;
+    long overrunCount = 0;
+    long skippedCount = 0;
+};
+
+// One g(r) sample per run in the given number of slices, writing g(r) and S(k)
+// to the series file every writeInterval samples, S(k) a few wavenumbers per
+// chunk.
+class StructureJob : public AnalysisJob {
+public:
+    StructureJob(PairStructure &structure, Diagnostics &diagnostics, const std::vector<double> &k, int writeInterval, int slices);
+
+    const char *name() const override { return "structure"; }
+    void begin(const Snapshot &snapshot) override;
+    bool resume() override;
+
+private:
+    PairStructure &structure;
+    Diagnostics &diagnostics;
+    std::vector<double> k;
+    std::vector<double> sk;
+    int writeInterval;
+    int slices;
+    const Snapshot *snapshot = nullptr;
+    int phase = 0;
+    int done = 0;
+};
+
+// Number density and mean velocity on a coarse grid of cellSize cells, chunk
+// particles per chunk, written to the series file as "density", "velocity_x"
+// and "velocity_y" over the row-major cell index.
+class DensityFieldJob : public AnalysisJob {
+public:
+    DensityFieldJob(float width, float height, float cellSize, int chunk, Diagnostics &diagnostics);
+
+    const char *name() const override { return "density"; }
+    void begin(const Snapshot &snapshot) override;
+    bool resume() override;
+
+    int nx, ny;
+    // Fields of the last completed run, row-major.
+    const std::vector<double> &density() const { return rho; }
+    const std::vector<double> &velocityX() const { return ux; }
+    const std::vector<double> &velocityY() const { return uy; }
+
+private:
+    float cellSize;
+    int chunk;
+    Diagnostics &diagnostics;
+    const Snapshot *snapshot = nullptr;
+    int phase = 0;
+    int done = 0;
+    std::vector<double> count, sumX, sumY;
+    std::vector<double> rho, ux, uy;
+    std::vector<double> index;
+};
+
+// Writes the snapshot to path, chunk particles per chunk, into path + ".tmp"
+// renamed over path at the end, so a crash never leaves a torn checkpoint. The
+// file is the line "PCHK1 <particles> <frame> <time>" followed by the
+// positions and velocities as native doubles and one active byte per particle.
+// Throws std::runtime_error if the file cannot be written.
+class CheckpointJob : public AnalysisJob {
+public:
+    CheckpointJob(const std::string &path, int chunk);
+    ~CheckpointJob();
+
+    const char *name() const override { return "checkpoint"; }
+    void begin(const Snapshot &snapshot) override;
+    bool resume() override;
+
+private:
+    std::string path;
+    int chunk;
+    const Snapshot *snapshot = nullptr;
+    std::FILE *file = nullptr;
+    int phase = 0;
+    int done = 0;
+};
+
+// Appends the snapshot to a trajectory as one frame, chunk particles of one
+// field per chunk, in the particle order the writer had when the run began.
+class RecordJob : public AnalysisJob {
+public:
+    RecordJob(TrajectoryWriter &writer, int chunk);
+
+    const char *name() const override { return "record"; }
+    void begin(const Snapshot &snapshot) override;
+    bool resume() override;
+
+private:
+    TrajectoryWriter &writer;
+    int chunk;
+    const Snapshot *snapshot = nullptr;
+    std::vector<int> rows;      // storage index per written row
+    std::vector<char> buffer;
+    int phase = 0;
+    int done = 0;
+};
+
+#endif // ANALYSIS_H
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "matrix.h"
+#include "threadpool.h"
+#include "grid.h"
+#include "structure.h"
+#include "clusters.h"
+#include "diagnostics.h"
+#include "trajectory.h"
+#include "defs.h"
+
+#define X 0
+#define Y 1
+
+// Batch analysis of a recorded trajectory (see trajectory.h); run as
+//   analyze <trajectory> [output prefix] [-b] [-j threads]
+// The file is mapped, not read, and the frames are shared out over the threads
+// in contiguous blocks, each thread with its own analysers running on a pool of
+// one. Writes
+//   <prefix>_frames.csv  per frame: diagnostics, contact clusters, mean squared
+//                        displacement from the first frame
+//   <prefix>_rdf.csv     g(r) averaged over all frames
+//   <prefix>_sk.csv      S(k) from it
+// With -b the frame table is written as binary columns instead: the line
+// "PCOL1 <rows> <columns>", the header line, then each column as native doubles.
+// Clusters and the diagnostics treat the box with the PERIODIC_X/Y this tool
+// was built with, which should match the recording.
+
+struct FrameRow {
+    double frame, time, particles;
+    double kinetic, potential, momentumX, momentumY, granularTemperature;
+    double contacts, overlapMean, overlapMax;
+    double clusters, largestCluster, clusteredFraction;
+    double msd;
+};
+static const int FRAME_COLUMNS = sizeof(FrameRow) / sizeof(double);
+static_assert(FRAME_COLUMNS == 15, "FRAME_HEADER names 15 columns");
+static const char *FRAME_HEADER =
+    "frame,time,particles,kinetic,potential,momentum_x,momentum_y,granular_temperature,"
+    "contacts,overlap_mean,overlap_max,clusters,largest_cluster,clustered_fraction,msd";
+
+// The analysers of one thread.
+struct Worker {
+    ThreadPool pool{1};
+    PairStructure structure;
+    ContactClusters clusters;
+    Diagnostics diagnostics{1};
+    CellGrid contacts;
+    matrix positions;
+    // Minimum-image displacement summed over the block, up to the next block's
+    // first frame, per particle.
+    std::vector<double> shift;
+    int start = 0, end = 0;
+
+    Worker(const TrajectoryHeader &h, float contactCell)
+        : structure(h.width, h.height, STRUCTURE_RMAX, STRUCTURE_BINS, h.periodicX != 0, h.periodicY != 0, pool),
+          clusters(static_cast<int>(h.particles), pool),
+          contacts(h.width, h.height, contactCell, h.periodicX != 0, h.periodicY != 0),
+          positions(static_cast<int>(h.particles), DIMENSION),
+          shift(2 * h.particles, 0.0)
+    {
+    }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void minimumImage(const TrajectoryHeader &h, double &dx, double &dy) {
+    if (h.periodicX) dx -= h.width * std::round(dx / h.width);
+    if (h.periodicY) dy -= h.height * std::round(dy / h.height);
+}
+
+// Add the displacement of every particle from frame a to frame b into sum.
+static void addStep(const TrajectoryHeader &h, const TrajectoryFrame &a, const TrajectoryFrame &b, std::vector<double> &sum) {
+    int n = static_cast<int>(h.particles);
+    for (int i = 0; i < n; ++i) {
+        double dx = b.positions[2 * i + X] - a.positions[2 * i + X];
+        double dy = b.positions[2 * i + Y] - a.positions[2 * i + Y];
+        minimumImage(h, dx, dy);
+        sum[2 * i + X] += dx;
+        sum[2 * i + Y] += dy;
+    }
+}
+
+// Diagnostics and contact clusters of one frame into row.
+static void analyseFrame(Worker &w, const TrajectoryHeader &h, const TrajectoryFrame &frame, FrameRow &row) {
+    int n = static_cast<int>(h.particles);
+    std::memcpy(w.positions.data.data(), frame.positions, 2 * n * sizeof(double));
+    w.structure.accumulate(w.positions, frame.active);
+
+    w.clusters.begin(w.positions, frame.active, frame.radius);
+    w.contacts.build(w.positions);
+    forEachCellPair(w.contacts, w.pool, [&](int i, int j, unsigned thread) {
+        if (!frame.active[i] || !frame.active[j]) return;
+        double dx = frame.positions[2 * j + X] - frame.positions[2 * i + X];
+        double dy = frame.positions[2 * j + Y] - frame.positions[2 * i + Y];
+        w.contacts.minimumImage(dx, dy);
+        double radiusSum = frame.radius[i] + frame.radius[j];
+        double dist2 = dx * dx + dy * dy;
+        if (dist2 >= radiusSum * radiusSum) return;
+        w.clusters.unite(thread, i, j);
+        w.diagnostics.addContact(thread, static_cast<float>(radiusSum - std::sqrt(dist2)));
+    });
+    w.clusters.finish(w.positions, frame.active);
+
+    for (int i = 0; i < n; ++i) {
+        if (!frame.active[i]) continue;
+        w.diagnostics.addParticle(0, frame.mass[i], frame.positions[2 * i + Y], frame.velocities[2 * i + X],
+                                  frame.velocities[2 * i + Y], h.height, GRAVITY);
+    }
+    // No wall impulses are recorded, so the pressures come out zero and are left out.
+    const Diagnostics::Row &d = w.diagnostics.end(frame.frame, frame.time, 0.0, h.width, h.height);
+
+    row.frame = static_cast<double>(frame.frame);
+    row.time = frame.time;
+    row.particles = d.particles;
+    row.kinetic = d.kinetic;
+    row.potential = d.potential;
+    row.momentumX = d.momentumX;
+    row.momentumY = d.momentumY;
+    row.granularTemperature = d.granularTemperature;
+    row.contacts = d.contacts;
+    row.overlapMean = d.overlapMean;
+    row.overlapMax = d.overlapMax;
+    double clustered = 0.0;
+    for (const auto &c : w.clusters.clusters()) clustered += c.size;
+    row.clusters = static_cast<double>(w.clusters.clusters().size());
+    row.largestCluster = w.clusters.clusters().empty() ? 0.0 : w.clusters.clusters().front().size;
+    row.clusteredFraction = d.particles > 0.0 ? clustered / d.particles : 0.0;
+}
+
+static std::FILE *openOutput(const std::string &path, const char *mode) {
+    std::FILE *file = std::fopen(path.c_str(), mode);
+    if (!file) {
+        throw std::runtime_error("Cannot open output file " + path);
+    }
+    return file;
+}
+
+static void writeFrames(const std::string &path, const std::vector<FrameRow> &rows, bool binary) {
+    std::FILE *file = openOutput(path, binary ? "wb" : "w");
+    if (binary) {
+        std::fprintf(file, "PCOL1 %zu %d\n%s\n", rows.size(), FRAME_COLUMNS, FRAME_HEADER);
+        std::vector<double> column(rows.size());
+        for (int c = 0; c < FRAME_COLUMNS; ++c) {
+            for (size_t r = 0; r < rows.size(); ++r) column[r] = (&rows[r].frame)[c];
+            std::fwrite(column.data(), sizeof(double), column.size(), file);
+        }
+    } else {
+        std::fprintf(file, "%s\n", FRAME_HEADER);
+        for (const FrameRow &row : rows) {
+            for (int c = 0; c < FRAME_COLUMNS; ++c) std::fprintf(file, c == 0 ? "%.17g" : ",%.17g", (&row.frame)[c]);
+            std::fputc('\n', file);
+        }
+    }
+    std::fclose(file);
+}
+
+static void writeCurve(const std::string &path, const char *header, const std::vector<double> &x, const std::vector<double> &y) {
+    std::FILE *file = openOutput(path, "w");
+    std::fprintf(file, "%s\n", header);
+    for (size_t k = 0; k < x.size(); ++k) std::fprintf(file, "%.9g,%.9g\n", x[k], y[k]);
+    std::fclose(file);
+}
+
+int main(int argc, char **argv) {
+    std::string input, prefix = "analysis";
+    bool binary = false;
+    unsigned numThreads = std::thread::hardware_concurrency();
+    int positional = 0;
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "-b") binary = true;
+        else if (arg == "-j" && a + 1 < argc) numThreads = static_cast<unsigned>(std::atoi(argv[++a]));
+        else if (positional++ == 0) input = arg;
+        else prefix = arg;
+    }
+    if (input.empty()) {
+        std::fprintf(stderr, "usage: analyze <trajectory> [output prefix] [-b] [-j threads]\n");
+        return 1;
+    }
+
+    try {
+        auto start = std::chrono::steady_clock::now();
+        TrajectoryReader reader(input);
+        const TrajectoryHeader &h = reader.header();
+        int n = reader.particles();
+        long frames = reader.frames();
+        if (frames == 0) {
+            throw std::runtime_error("No frames in " + input);
+        }
+
+        if (numThreads == 0) {
+            numThreads = 4;
+        }
+        ThreadPool pool(numThreads);
+
+        // Contacts need cells as wide as the largest pair of radii anywhere.
+        std::vector<float> threadRadius(pool.size(), 0.0f);
+        pool.parallelFor(static_cast<int>(frames), [&](int first, int last, unsigned thread) {
+            for (int f = first; f < last; ++f) {
+                TrajectoryFrame frame = reader.frame(f);
+                for (int i = 0; i < n; ++i) threadRadius[thread] = std::max(threadRadius[thread], frame.radius[i]);
+            }
+        });
+        float maxRadius = *std::max_element(threadRadius.begin(), threadRadius.end());
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (unsigned t = 0; t < pool.size(); ++t) {
+            workers.emplace_back(new Worker(h, std::max(2.0f * maxRadius, 1.0f)));
+        }
+
+        // Per-frame analyses, and each block's summed displacement for the MSD.
+        std::vector<FrameRow> rows(frames);
+        pool.parallelFor(static_cast<int>(frames), [&](int first, int last, unsigned thread) {
+            Worker &w = *workers[thread];
+            w.start = first;
+            w.end = last;
+            for (int f = first; f < last; ++f) {
+                TrajectoryFrame frame = reader.frame(f);
+                analyseFrame(w, h, frame, rows[f]);
+                if (f + 1 < frames) addStep(h, frame, reader.frame(f + 1), w.shift);
+            }
+        });
+
+        // Unwrapped displacement from the first frame at the start of each block,
+        // then the MSD of every frame from it, over the particles active in both.
+        std::vector<std::vector<double>> offset(pool.size());
+        std::vector<double> sum(2 * n, 0.0);
+        for (unsigned t = 0; t < pool.size(); ++t) {
+            offset[t] = sum;
+            for (int k = 0; k < 2 * n; ++k) sum[k] += workers[t]->shift[k];
+        }
+        TrajectoryFrame first = reader.frame(0);
+        pool.parallelFor(static_cast<int>(pool.size()), [&](int begin, int end) {
+            for (int t = begin; t < end; ++t) {
+                std::vector<double> &u = offset[t];
+                for (int f = workers[t]->start; f < workers[t]->end; ++f) {
+                    TrajectoryFrame frame = reader.frame(f);
+                    double total = 0.0;
+                    int counted = 0;
+                    for (int i = 0; i < n; ++i) {
+                        if (!first.active[i] || !frame.active[i]) continue;
+                        total += u[2 * i + X] * u[2 * i + X] + u[2 * i + Y] * u[2 * i + Y];
+                        counted++;
+                    }
+                    rows[f].msd = counted > 0 ? total / counted : 0.0;
+                    if (f + 1 < frames) addStep(h, frame, reader.frame(f + 1), u);
+                }
+            }
+        });
+
+        PairStructure &structure = workers[0]->structure;
+        for (unsigned t = 1; t < pool.size(); ++t) structure.merge(workers[t]->structure);
+        std::vector<double> k(STRUCTURE_KBINS);
+        for (int q = 0; q < STRUCTURE_KBINS; ++q) k[q] = (q + 1) * STRUCTURE_KMAX / STRUCTURE_KBINS;
+
+        writeFrames(prefix + "_frames.csv", rows, binary);
+        writeCurve(prefix + "_rdf.csv", "r,g", structure.radii(), structure.rdf());
+        writeCurve(prefix + "_sk.csv", "k,S", k, structure.structureFactor(k));
+
+        double seconds = secondsSince(start);
+        std::printf("analyze: %ld frames of %d particles on %u threads in %.3f s (%.1f frames/s, %.0f MB/s)\n",
+                    frames, n, pool.size(), seconds, frames / seconds,
+                    frames * static_cast<double>(h.frameBytes) / seconds / 1e6);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "analyze: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
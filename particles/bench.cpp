@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "matrix.h"
+#include "threadpool.h"
+#include "md.h"
+#include "thermostat.h"
+#include "dpd.h"
+#include "boids.h"
+#include "edmd.h"
+#include "xpbd.h"
+#include "bonds.h"
+#include "shapematch.h"
+#include "spheres.h"
+#include "grid.h"
+#include "structure.h"
+#include "defs.h"
+
+#define XPBD_BENCH_PARTICLES 20000
+#define XPBD_BENCH_SETTLED 0.05
+#define XPBD_BENCH_SECONDS 10
+#define STRUCTURE_BENCH_SAMPLES 20
+// Ten Langevin relaxation times at the default friction; T* is averaged over
+// the last quarter.
+#define THERMOSTAT_BENCH_STEPS 2000
+
+// Headless benchmarks for the solvers; run as "bench [name]" or "bench" for all.
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// LJ liquid in reduced units (sigma = epsilon = m = 1), reported with the same
+// performance metrics LAMMPS prints. The state point is that of the LAMMPS LJ
+// benchmark, but this system is 2D, so it is a different liquid and the numbers
+// only track this code's own throughput.
+static void benchLennardJones(ThreadPool &pool) {
+    const int n = MD_BENCH_PARTICLES;
+    const double density = 0.8442;
+    const double temperature = 1.44;
+    const double dt = 0.005;
+    const int steps = MD_BENCH_STEPS;
+
+    double box = std::sqrt(n / density);
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    LennardJones md(box, box, 1.0, 1.0, 1.0, MD_CUTOFF, MD_SKIN, pool);
+    md.initLattice(positions, velocities, temperature);
+
+    md.step(positions, velocities, dt);
+    double e0 = md.potentialEnergy() + md.kineticEnergy(velocities);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        md.step(positions, velocities, dt);
+    }
+    double seconds = secondsSince(start);
+    double e1 = md.potentialEnergy() + md.kineticEnergy(velocities);
+
+    std::printf("lj: %d atoms, rho* %.4f, T* %.2f, rc %.2f, skin %.2f, dt %.3f, %d threads\n",
+                n, density, temperature, MD_CUTOFF, MD_SKIN, dt, pool.size());
+    std::printf("  %.3f s for %d steps: %.1f timesteps/s, %.1f katom-step/s, %.0f tau/day\n",
+                seconds, steps, steps / seconds, n * steps / seconds / 1000.0,
+                steps * dt / seconds * 86400.0);
+    std::printf("  neighbor rebuilds %d, energy drift %.3e per atom\n",
+                md.neighborRebuilds(), (e1 - e0) / n);
+}
+
+// g(r) and S(k) of the LJ liquid above, sampled every 10 steps: the cost of a
+// sample and the height and place of the first peaks.
+static void benchStructure(ThreadPool &pool) {
+    const int n = MD_BENCH_PARTICLES;
+    const double density = 0.8442;
+    const double dt = 0.005;
+    const float rMax = 5.0f;
+    const int bins = 250;
+
+    double box = std::sqrt(n / density);
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    LennardJones md(box, box, 1.0, 1.0, 1.0, MD_CUTOFF, MD_SKIN, pool);
+    md.initLattice(positions, velocities, 1.44);
+    for (int s = 0; s < MD_BENCH_STEPS; ++s) md.step(positions, velocities, dt);
+
+    PairStructure structure(box, box, rMax, bins, true, true, pool);
+    double seconds = 0.0;
+    for (int sample = 0; sample < STRUCTURE_BENCH_SAMPLES; ++sample) {
+        for (int s = 0; s < 10; ++s) md.step(positions, velocities, dt);
+        auto start = std::chrono::steady_clock::now();
+        structure.accumulate(positions);
+        seconds += secondsSince(start);
+    }
+
+    std::vector<double> r = structure.radii(), g = structure.rdf();
+    std::vector<double> k(200);
+    for (int q = 0; q < 200; ++q) k[q] = (q + 1) * 0.1;
+    std::vector<double> sk = structure.structureFactor(k);
+    int gPeak = static_cast<int>(std::max_element(g.begin(), g.end()) - g.begin());
+    int sPeak = static_cast<int>(std::max_element(sk.begin(), sk.end()) - sk.begin());
+    double tail = 0.0;
+    for (int b = bins * 4 / 5; b < bins; ++b) tail += g[b];
+    tail /= bins - bins * 4 / 5;
+
+    std::printf("structure: %d atoms, rMax %.1f, %d bins, %d samples in %.3f s (%.2f ms/sample, %.1f M atoms/s)\n",
+                n, rMax, bins, STRUCTURE_BENCH_SAMPLES, seconds, seconds / STRUCTURE_BENCH_SAMPLES * 1000.0,
+                static_cast<double>(n) * STRUCTURE_BENCH_SAMPLES / seconds / 1e6);
+    std::printf("  g(r) peak %.3f at r %.3f, g(r > %.1f) %.4f; S(k) peak %.3f at k %.2f\n",
+                g[gPeak], r[gPeak], 0.8 * rMax, tail, sk[sPeak], k[sPeak]);
+}
+
+// The same liquid started cold and brought to temperature by each thermostat;
+// the step rate against the plain run is the cost of the fused update.
+static void benchThermostats(ThreadPool &pool) {
+    const int n = MD_BENCH_PARTICLES;
+    const double density = 0.8442;
+    const double target = 1.44;
+    const double dt = 0.005;
+    const int steps = THERMOSTAT_BENCH_STEPS;
+    const int averaged = steps / 4;
+    const Thermostat::Kind kinds[] = { Thermostat::NONE, Thermostat::LANGEVIN, Thermostat::BERENDSEN };
+    const char *names[] = { "none", "langevin", "berendsen" };
+
+    double box = std::sqrt(n / density);
+    for (int k = 0; k < 3; ++k) {
+        matrix positions(n, DIMENSION);
+        matrix velocities(n, DIMENSION);
+        LennardJones md(box, box, 1.0, 1.0, 1.0, MD_CUTOFF, MD_SKIN, pool);
+        md.initLattice(positions, velocities, 0.5);
+        Thermostat thermostat(kinds[k], target, pool.size());
+        Thermostat *used = kinds[k] == Thermostat::NONE ? nullptr : &thermostat;
+
+        auto start = std::chrono::steady_clock::now();
+        double sum = 0.0, sum2 = 0.0;
+        for (int s = 0; s < steps; ++s) {
+            md.step(positions, velocities, dt, used);
+            if (s >= steps - averaged) {
+                double t = used ? used->measuredTemperature() : md.kineticEnergy(velocities) / n;
+                sum += t;
+                sum2 += t * t;
+            }
+        }
+        double seconds = secondsSince(start);
+        double mean = sum / averaged;
+        std::printf("thermostat %-9s: T* %.3f +- %.3f over the last %d of %d steps (target %.2f), %.1f timesteps/s\n",
+                    names[k], mean, std::sqrt(std::max(sum2 / averaged - mean * mean, 0.0)), averaged, steps,
+                    target, steps / seconds);
+    }
+}
+
+// DPD fluid at the usual density of 3 per rc^2, started cold: the pair
+// thermostat should bring it to kT = 1 and keep it there.
+static void benchDpd(ThreadPool &pool) {
+    const int n = DPD_BENCH_PARTICLES;
+    const double rc = 1.0;
+    const double box = std::sqrt(n / 3.0) * rc;
+    const double dt = DPD_TIMESTEP;
+    const int steps = DPD_BENCH_STEPS;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    DissipativeParticles dpd(box, box, rc, DPD_REPULSION, DPD_FRICTION, 1.0, pool);
+    dpd.initRandom(positions, velocities);
+    velocities.zero();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        dpd.step(positions, velocities, dt);
+    }
+    double seconds = secondsSince(start);
+
+    double px = 0.0, py = 0.0;
+    for (int i = 0; i < n; ++i) {
+        px += velocities(i, 0);
+        py += velocities(i, 1);
+    }
+    std::printf("dpd: %d particles, %d steps in %.3f s (%.1f timesteps/s), kT %.3f, momentum (%.2e, %.2e)\n",
+                n, steps, seconds, steps / seconds, dpd.temperature(velocities), px, py);
+}
+
+// Boids at the window's density in a box scaled up for the agent count.
+static void benchBoids(ThreadPool &pool) {
+    const int n = BOIDS_BENCH_AGENTS;
+    const int steps = BOIDS_BENCH_STEPS;
+    const float scale = std::sqrt(static_cast<float>(n) / BOIDS_AGENTS);
+    Flock flock(WINDOW_X * scale, WINDOW_Y * scale, BOIDS_RADIUS, pool);
+    flock.init(n, BOIDS_SEED);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) {
+        flock.step(1.0f / 60.0f);
+    }
+    double seconds = secondsSince(start);
+    std::printf("boids: %d agents, %d steps in %.3f s (%.1f steps/s, %.2f M agent-steps/s)\n",
+                n, steps, seconds, steps / seconds, static_cast<double>(n) * steps / seconds / 1e6);
+}
+
+// Dilute hard-disc gas: events and collisions processed per second.
+static void benchHardSpheres(ThreadPool &pool) {
+    const int n = NUM_PARTICLES;
+    const double simulated = 1.0;
+    const double frame = 1.0 / 60.0;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    HardSphereEDMD edmd(WINDOW_X, WINDOW_Y, RADIUS, EDMD_RESTITUTION, pool);
+    edmd.initGas(positions, velocities, EDMD_SPEED);
+
+    auto start = std::chrono::steady_clock::now();
+    for (double t = 0.0; t < simulated; t += frame) {
+        edmd.advance(positions, velocities, frame);
+    }
+    double seconds = secondsSince(start);
+
+    std::printf("edmd: %d discs, area fraction %.3f, %.1f s simulated in %.3f s\n",
+                n, n * 3.14159265 * RADIUS * RADIUS / (WINDOW_X * WINDOW_Y), simulated, seconds);
+    std::printf("  %lld events (%.2f M/s), %lld collisions, %lld cell crossings\n",
+                edmd.eventsProcessed(), edmd.eventsProcessed() / seconds / 1e6,
+                edmd.collisions(), edmd.cellCrossings());
+}
+
+// Column of discs dropped into a narrow box, run a second at a time until the
+// pile sinks less than XPBD_BENCH_SETTLED per second: solver iterations per
+// second, and the residual penetration and sinking of the settled pile.
+static void benchXpbd(ThreadPool &pool) {
+    const int n = XPBD_BENCH_PARTICLES;
+    const float width = 200.0f, height = 400.0f;
+    const double frame = 1.0 / 60.0;
+    const int perSecond = 60;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    // Loose hexagonal packing resting on the floor.
+    double spacing = 2.1 * RADIUS;
+    int cols = static_cast<int>((width - 2.0f) / spacing) - 1;
+    for (int i = 0; i < n; ++i) {
+        positions(i, 0) = 1.0 + (i % cols + 0.5 * (i / cols % 2)) * spacing;
+        positions(i, 1) = height - 1.0 - (i / cols) * spacing * 0.866;
+    }
+    XpbdSolver xpbd(width, height, RADIUS, pool);
+
+    auto centreHeight = [&]() {
+        double sum = 0.0;
+        for (int i = 0; i < n; ++i) sum += positions(i, 1);
+        return sum / n;
+    };
+
+    int seconds = 0;
+    double sank = 0.0;
+    long long lastIterations = 0, lastSubsteps = 0;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        double before = centreHeight();
+        lastIterations = xpbd.iterationsRun();
+        lastSubsteps = xpbd.substepsRun();
+        for (int f = 0; f < perSecond; ++f) xpbd.step(positions, velocities, frame, GRAVITY);
+        sank = centreHeight() - before;
+        seconds++;
+    } while (std::abs(sank) > XPBD_BENCH_SETTLED && seconds < XPBD_BENCH_SECONDS);
+    double elapsed = secondsSince(start);
+    long long iterations = xpbd.iterationsRun();
+
+    std::printf("xpbd: %d discs, %d substeps (%d in the last frame) x %d-%d iterations (%.1f on average), %d frames in %.3f s\n",
+                n, xpbd.substeps, xpbd.substepsUsed(), xpbd.iterations, XPBD_MAX_ITERATIONS,
+                static_cast<double>(iterations) / xpbd.substepsRun(), seconds * perSecond, elapsed);
+    std::printf("  %.1f iterations/s, %.2f M contact solves/s\n",
+                iterations / elapsed, xpbd.constraintSolves() / elapsed / 1e6);
+    std::printf("  %s after %d s: %.1f iterations per substep, penetration max %.4f mean %.4f (radius %.2f), sank %.4f in the last second\n",
+                std::abs(sank) > XPBD_BENCH_SETTLED ? "not settled" : "settled", seconds,
+                static_cast<double>(iterations - lastIterations) / (xpbd.substepsRun() - lastSubsteps),
+                xpbd.maxPenetration(), xpbd.meanPenetration(), RADIUS, sank);
+}
+
+// One large bonded sheet falling under gravity: bond updates per second, and the
+// cost of re-sorting particles and bonds into cell order.
+static void benchBonds(ThreadPool &pool) {
+    const int side = BOND_BENCH_SIDE;
+    const int n = side * side;
+    const double frame = 1.0 / 60.0;
+    const int frames = BOND_BENCH_FRAMES;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    for (int i = 0; i < n; ++i) {
+        positions(i, 0) = (i % side) * BOND_SPACING;
+        positions(i, 1) = (i / side) * BOND_SPACING;
+    }
+    BondNetwork bonds(pool);
+    bonds.connect(positions, 0, n, BOND_RANGE * BOND_SPACING);
+    int total = bonds.bondCount();
+
+    // Shuffle the storage first so the sort has something to do.
+    std::vector<int> shuffled(n);
+    for (int i = 0; i < n; ++i) shuffled[i] = (static_cast<long long>(i) * 7919) % n;
+    positions.permuteRows(shuffled);
+    bonds.permute(shuffled);
+
+    auto start = std::chrono::steady_clock::now();
+    CellGrid grid(side * BOND_SPACING, side * BOND_SPACING, CELL_SIZE, false);
+    grid.build(positions);
+    std::vector<int> order = grid.cellParticles;
+    positions.permuteRows(order);
+    velocities.permuteRows(order);
+    bonds.permute(order);
+    double sortSeconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        for (int i = 0; i < n; ++i) velocities(i, 1) += GRAVITY * frame;
+        bonds.apply(positions, velocities, frame);
+        for (size_t k = 0; k < positions.data.size(); ++k) positions.data[k] += frame * velocities.data[k];
+    }
+    double seconds = secondsSince(start);
+
+    std::printf("bonds: %d particles, %d bonds, %d frames in %.3f s (%.1f frames/s)\n",
+                n, total, frames, seconds, frames / seconds);
+    std::printf("  %.1f M bond updates/s, sort %.1f ms, %d broken\n",
+                2.0 * total * frames / seconds / 1e6, sortSeconds * 1000.0, bonds.brokenCount());
+}
+
+// Stiff bonded sheet with a random initial velocity field, stepped implicitly at
+// the frame time: CG iterations per frame and how far the bonds stray from rest.
+static void benchImplicitBonds(ThreadPool &pool) {
+    const int side = BOND_BENCH_SIDE / 2;
+    const int n = side * side;
+    const double frame = 1.0 / 60.0;
+    const int frames = BOND_BENCH_FRAMES;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    for (int i = 0; i < n; ++i) {
+        positions(i, 0) = (i % side) * BOND_SPACING;
+        positions(i, 1) = (i / side) * BOND_SPACING;
+        velocities(i, 0) = (static_cast<long long>(i) * 7919 % 101 - 50) * 1.0;
+        velocities(i, 1) = (static_cast<long long>(i) * 104729 % 101 - 50) * 1.0;
+    }
+    BondNetwork bonds(pool);
+    bonds.breakStrain = 1e9;
+    bonds.connect(positions, 0, n, BOND_RANGE * BOND_SPACING);
+
+    long long iterations = 0;
+    double worst = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        bonds.solveImplicit(positions, velocities, frame);
+        iterations += bonds.lastIterations();
+        for (size_t k = 0; k < positions.data.size(); ++k) positions.data[k] += frame * velocities.data[k];
+        worst = std::max(worst, bonds.maxStrain(positions));
+    }
+    double seconds = secondsSince(start);
+
+    // Explicit stability needs dt < 2 / sqrt(k * lambda), with lambda up to ~8 for
+    // this lattice.
+    int explicitSubsteps = static_cast<int>(std::ceil(frame * std::sqrt(8.0 * bonds.implicitStiffness) / 2.0));
+    std::printf("implicit bonds: %d particles, %d bonds, k %.0e, %d frames in %.3f s (%.1f frames/s)\n",
+                n, bonds.bondCount(), bonds.implicitStiffness, frames, seconds, frames / seconds);
+    std::printf("  %.1f CG iterations/frame, %ld of %d solves unconverged, max strain %.4f, explicit would need %d substeps/frame\n",
+                static_cast<double>(iterations) / frames, bonds.unconvergedSolves(), frames, worst, explicitSubsteps);
+}
+
+// Thousands of small rigid clusters, each spinning: shape-matching throughput and
+// how well the clusters keep their shape (diagonal length error).
+static void benchShapeMatching(ThreadPool &pool) {
+    const int clusters = SHAPE_BENCH_CLUSTERS;
+    const int side = 4;
+    const int size = side * side;
+    const int n = clusters * size;
+    const double frame = 1.0 / 60.0;
+    const int frames = SHAPE_BENCH_FRAMES;
+    const int perRow = 100;
+
+    matrix positions(n, DIMENSION);
+    matrix velocities(n, DIMENSION);
+    ShapeMatching shapes(pool);
+    std::vector<int> members(size);
+    for (int c = 0; c < clusters; ++c) {
+        double ox = (c % perRow) * 10.0, oy = (c / perRow) * 10.0;
+        double omega = (c % 7 - 3) * 2.0;
+        for (int k = 0; k < size; ++k) {
+            int i = c * size + k;
+            double rx = (k % side - 1.5) * 2.0 * RADIUS, ry = (k / side - 1.5) * 2.0 * RADIUS;
+            positions(i, 0) = ox + rx;
+            positions(i, 1) = oy + ry;
+            velocities(i, 0) = -omega * ry;
+            velocities(i, 1) = omega * rx;
+            members[k] = i;
+        }
+        shapes.addCluster(positions, members);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; ++f) {
+        shapes.apply(positions, velocities, frame);
+        for (size_t k = 0; k < positions.data.size(); ++k) positions.data[k] += frame * velocities.data[k];
+    }
+    double seconds = secondsSince(start);
+
+    double rest = std::sqrt(2.0) * (side - 1) * 2.0 * RADIUS;
+    double worst = 0.0;
+    for (int c = 0; c < clusters; ++c) {
+        int a = c * size, b = c * size + size - 1;
+        double dx = positions(b, 0) - positions(a, 0), dy = positions(b, 1) - positions(a, 1);
+        worst = std::max(worst, std::fabs(std::sqrt(dx * dx + dy * dy) - rest) / rest);
+    }
+    std::printf("shape: %d clusters of %d particles, %d frames in %.3f s\n", clusters, size, frames, seconds);
+    std::printf("  %.2f M cluster updates/s, max diagonal error %.2e\n",
+                static_cast<double>(clusters) * frames / seconds / 1e6, worst);
+}
+
+// The same falling pile in 2D and 3D through the dimension-templated kernel.
+template <int D>
+static void benchSpheres(ThreadPool &pool) {
+    const int n = D3_BENCH_PARTICLES;
+    const int steps = D3_BENCH_STEPS;
+    const double dt = 1.0 / 60.0;
+
+    std::array<float, D> box;
+    for (int d = 0; d < D; ++d) box[d] = D == 3 ? D3_BOX_X : 500.0f;
+    float radius = D == 3 ? D3_RADIUS : 1.0f;
+    matrix positions(n, D);
+    matrix velocities(n, D);
+    for (int i = 0; i < n; ++i) {
+        for (int d = 0; d < D; ++d) positions(i, d) = (static_cast<long long>(i) * (7919 + 104729 * d) % 100003) / 100003.0 * box[d];
+    }
+    ImpulseSpheres<D> spheres(box, radius, pool);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; ++s) spheres.step(positions, velocities, dt, GRAVITY);
+    double seconds = secondsSince(start);
+
+    std::printf("spheres %dD: %d particles, %d steps in %.3f s (%.1f steps/s, %.2f M particle-steps/s)\n",
+                D, n, steps, seconds, steps / seconds, static_cast<double>(n) * steps / seconds / 1e6);
+}
+
+int main(int argc, char **argv) {
+    std::string which = argc > 1 ? argv[1] : "all";
+    unsigned numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0) {
+        numThreads = 4;
+    }
+    ThreadPool pool(numThreads);
+
+    if (which == "all" || which == "lj") benchLennardJones(pool);
+    if (which == "all" || which == "structure") benchStructure(pool);
+    if (which == "all" || which == "thermostat") benchThermostats(pool);
+    if (which == "all" || which == "dpd") benchDpd(pool);
+    if (which == "all" || which == "boids") benchBoids(pool);
+    if (which == "all" || which == "edmd") benchHardSpheres(pool);
+    if (which == "all" || which == "xpbd") benchXpbd(pool);
+    if (which == "all" || which == "bonds") benchBonds(pool);
+    if (which == "all" || which == "implicit") benchImplicitBonds(pool);
+    if (which == "all" || which == "shape") benchShapeMatching(pool);
+    if (which == "all" || which == "spheres") {
+        benchSpheres<2>(pool);
+        benchSpheres<3>(pool);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "boids.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+// 1 if v's sign bit is set, else 0. A float compare would keep the lane loop
+// from vectorising (it may trap, so the compiler will not if-convert it), but
+// reading the sign bit is integer arithmetic. d2 - r2 is negative exactly when
+// d2 < r2, and 0 - d2 when d2 > 0, since x - x is +0.
+static inline float negative(float v) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &v, sizeof bits);
+    return static_cast<float>(static_cast<std::int32_t>(bits >> 31));
+}
+
+Flock::Flock(float width, float height, float radius, ThreadPool &pool)
+    : radius(radius), grid(width, height, radius, true), pool(pool)
+{
+}
+
+void Flock::init(int count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> ux(0.0f, grid.width), uy(0.0f, grid.height);
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    float speed = 0.5f * (minSpeed + maxSpeed);
+    agents = count;
+    x.assign(count + BOIDS_LANES, 0.0f);
+    y.assign(count + BOIDS_LANES, 0.0f);
+    vx.assign(count + BOIDS_LANES, 0.0f);
+    vy.assign(count + BOIDS_LANES, 0.0f);
+    for (int i = 0; i < count; ++i) {
+        x[i] = ux(gen);
+        y[i] = uy(gen);
+        float a = angle(gen);
+        vx[i] = speed * std::cos(a);
+        vy[i] = speed * std::sin(a);
+    }
+}
+
+// Bucket the agents and gather their state into cell order.
+void Flock::sortByCell() {
+    int n = size();
+    grid.build(x.data(), y.data(), n);
+    sortedX.resize(n + BOIDS_LANES);
+    sortedY.resize(n + BOIDS_LANES);
+    sortedVX.resize(n + BOIDS_LANES);
+    sortedVY.resize(n + BOIDS_LANES);
+    const int *order = grid.cellParticles.data();
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int k = start; k < end; ++k) {
+            int i = order[k];
+            sortedX[k] = x[i];
+            sortedY[k] = y[i];
+            sortedVX[k] = vx[i];
+            sortedVY[k] = vy[i];
+        }
+    });
+    x.swap(sortedX);
+    y.swap(sortedY);
+    vx.swap(sortedVX);
+    vy.swap(sortedVY);
+}
+
+// Agents are in cell order, so agent k of cell c is just k.
+void Flock::steerCell(int cx, int cy, float dt) {
+    int home = cy * grid.nx + cx;
+    int homeStart = grid.cellStart[home], homeEnd = grid.cellStart[home + 1];
+    if (homeStart == homeEnd) return;
+
+    // The 3x3 block as runs of consecutive agents, each with the shift that
+    // brings its periodic image next to the home cell. A row that does not wrap
+    // in x is a single run.
+    int runStart[9], runEnd[9];
+    float shiftX[9], shiftY[9];
+    int runs = 0;
+    for (int oy = -1; oy <= 1; ++oy) {
+        int row = grid.neighbor(cx, cy, 0, oy) - cx;
+        float sy = cy + oy < 0 ? -grid.height : (cy + oy >= grid.ny ? grid.height : 0.0f);
+        if (cx > 0 && cx + 1 < grid.nx) {
+            runStart[runs] = grid.cellStart[row + cx - 1];
+            runEnd[runs] = grid.cellStart[row + cx + 2];
+            shiftX[runs] = 0.0f;
+            shiftY[runs++] = sy;
+            continue;
+        }
+        for (int ox = -1; ox <= 1; ++ox) {
+            int other = grid.neighbor(cx, cy, ox, oy);
+            runStart[runs] = grid.cellStart[other];
+            runEnd[runs] = grid.cellStart[other + 1];
+            shiftX[runs] = cx + ox < 0 ? -grid.width : (cx + ox >= grid.nx ? grid.width : 0.0f);
+            shiftY[runs++] = sy;
+        }
+    }
+
+    const float *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+    const float r2 = radius * radius;
+    const float sep2 = separationRadius * separationRadius;
+    // ahead >= cos * d is tested as ahead |ahead| >= cos |cos| d^2: t |t| is
+    // monotonic, and this needs no square root.
+    const float view = fieldOfView * std::fabs(fieldOfView);
+
+    for (int i = homeStart; i < homeEnd; ++i) {
+        float xi = px[i], yi = py[i], vxi = pvx[i], vyi = pvy[i];
+        float speed = std::sqrt(vxi * vxi + vyi * vyi);
+        float hx = speed > 0.0f ? vxi / speed : 1.0f;
+        float hy = speed > 0.0f ? vyi / speed : 0.0f;
+
+        // Lane l sums every BOIDS_LANES-th neighbour, so the lane loop
+        // vectorises (one packed operation per step of the body, checked with
+        // -fopt-info-vec) without reassociating float sums. Each test is a 0/1
+        // float mask from negative() and the masks multiply; the division runs
+        // for every lane, on a denominator kept above zero. A run's last block
+        // reads on into the next run or the padding and masks those out.
+        float count[BOIDS_LANES] = {}, sumX[BOIDS_LANES] = {}, sumY[BOIDS_LANES] = {};
+        float sumVX[BOIDS_LANES] = {}, sumVY[BOIDS_LANES] = {};
+        float pushX[BOIDS_LANES] = {}, pushY[BOIDS_LANES] = {};
+        for (int r = 0; r < runs; ++r) {
+            float offX = shiftX[r] - xi, offY = shiftY[r] - yi;
+            const int end = runEnd[r];
+            for (int k = runStart[r]; k < end; k += BOIDS_LANES) {
+                for (int l = 0; l < BOIDS_LANES; ++l) {
+                    float dx = px[k + l] + offX, dy = py[k + l] + offY;
+                    float d2 = dx * dx + dy * dy;
+                    float ahead = dx * hx + dy * hy;
+                    float inRun = static_cast<float>(k + l < end);
+                    float inRange = negative(d2 - r2);
+                    float other = negative(0.0f - d2);
+                    float inView = 1.0f - negative(ahead * std::fabs(ahead) - view * d2);
+                    float close = negative(d2 - sep2);
+                    float w = inRun * inRange * other * inView;
+                    float push = w * close / (d2 + (1.0f - other));
+                    count[l] += w;
+                    sumX[l] += w * dx;
+                    sumY[l] += w * dy;
+                    sumVX[l] += w * pvx[k + l];
+                    sumVY[l] += w * pvy[k + l];
+                    pushX[l] -= push * dx;
+                    pushY[l] -= push * dy;
+                }
+            }
+        }
+        for (int l = 1; l < BOIDS_LANES; ++l) {
+            count[0] += count[l];
+            sumX[0] += sumX[l];
+            sumY[0] += sumY[l];
+            sumVX[0] += sumVX[l];
+            sumVY[0] += sumVY[l];
+            pushX[0] += pushX[l];
+            pushY[0] += pushY[l];
+        }
+
+        float ax = separation * pushX[0], ay = separation * pushY[0];
+        if (count[0] > 0.0f) {
+            float inv = 1.0f / count[0];
+            ax += alignment * (sumVX[0] * inv - vxi) + cohesion * sumX[0] * inv;
+            ay += alignment * (sumVY[0] * inv - vyi) + cohesion * sumY[0] * inv;
+        }
+        float nvx = vxi + ax * dt, nvy = vyi + ay * dt;
+        float s = std::sqrt(nvx * nvx + nvy * nvy);
+        if (s > maxSpeed) {
+            nvx *= maxSpeed / s;
+            nvy *= maxSpeed / s;
+        } else if (s < minSpeed) {
+            nvx = s > 0.0f ? nvx * minSpeed / s : minSpeed * hx;
+            nvy = s > 0.0f ? nvy * minSpeed / s : minSpeed * hy;
+        }
+        newVX[i] = nvx;
+        newVY[i] = nvy;
+    }
+}
+
+void Flock::step(float dt) {
+    int n = size();
+    sortByCell();
+    newVX.resize(n);
+    newVY.resize(n);
+
+    // Every agent reads the old velocities and writes only its own new one, so
+    // cells steer in parallel with no colouring.
+    pool.parallelFor(grid.numCells(), [&](int start, int end) {
+        for (int c = start; c < end; ++c) steerCell(c % grid.nx, c / grid.nx, dt);
+    });
+
+    const float width = grid.width, height = grid.height;
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            vx[i] = newVX[i];
+            vy[i] = newVY[i];
+            x[i] += vx[i] * dt;
+            y[i] += vy[i] * dt;
+            x[i] -= width * std::floor(x[i] / width);
+            y[i] -= height * std::floor(y[i] / height);
+        }
+    });
+}
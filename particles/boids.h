@@ -0,0 +1,58 @@
+#ifndef BOIDS_H
+#define BOIDS_H
+
+#include <vector>
+#include "grid.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Boids (Reynolds) in a periodic box. An agent sees the neighbours within the
+// perception radius that lie inside its field of view (cos of the half angle
+// around its heading) and steers by
+//   separation  away from those closer than separationRadius, weighted 1 / d,
+//   alignment   towards their mean velocity,
+//   cohesion    towards their centre,
+// keeping its speed within [minSpeed, maxSpeed]. Radius queries use the shared
+// cell grid with cells one perception radius wide.
+//
+// State is SoA and re-sorted into cell order every step, so the agents of a cell
+// and its neighbours sit in a few contiguous runs, and the inner steering loop
+// walks them BOIDS_LANES at a time with arithmetic masks in place of branches,
+// which GCC vectorises at -O2 (SSE, or AVX with -mavx2). Agents carry no
+// identity, so the reordering is free to do.
+class Flock {
+public:
+    Flock(float width, float height, float radius, ThreadPool &pool);
+
+    // count agents at random positions, heading in random directions.
+    void init(int count, unsigned seed);
+
+    void step(float dt);
+
+    int size() const { return agents; }
+
+    // Agent state in cell order, followed by BOIDS_LANES zeros of padding.
+    std::vector<float> x, y, vx, vy;
+
+    float separationRadius = BOIDS_SEPARATION_RADIUS;
+    float separation = BOIDS_SEPARATION;
+    float alignment = BOIDS_ALIGNMENT;
+    float cohesion = BOIDS_COHESION;
+    float fieldOfView = BOIDS_FIELD_OF_VIEW;
+    float minSpeed = BOIDS_MIN_SPEED;
+    float maxSpeed = BOIDS_MAX_SPEED;
+
+private:
+    void sortByCell();
+    void steerCell(int cx, int cy, float dt);
+
+    int agents = 0;
+    float radius;
+    CellGrid grid;
+    ThreadPool &pool;
+
+    std::vector<float> sortedX, sortedY, sortedVX, sortedVY;
+    std::vector<float> newVX, newVY;
+};
+
+#endif // BOIDS_H
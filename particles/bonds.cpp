@@ -0,0 +1,358 @@
+#include "bonds.h"
+
+#include <algorithm>
+#include <cmath>
+#include "grid.h"
+#include "cblas.h"
+
+#define X 0
+#define Y 1
+
+BondNetwork::BondNetwork(ThreadPool &pool) : pool(pool) {}
+
+int BondNetwork::bondCount() const {
+    int kept = 0;
+    for (char ok : intact) kept += ok;
+    return kept / 2;
+}
+
+int BondNetwork::brokenCount() const {
+    int broken = 0;
+    for (char ok : intact) broken += !ok;
+    return broken / 2;
+}
+
+std::vector<BondNetwork::Bond> BondNetwork::intactBonds() const {
+    std::vector<Bond> bonds;
+    int n = static_cast<int>(rowStart.size()) - 1;
+    for (int i = 0; i < n; ++i) {
+        for (int k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            if (intact[k] && i < partner[k]) bonds.push_back({i, partner[k], restLength[k]});
+        }
+    }
+    return bonds;
+}
+
+void BondNetwork::buildRows(int n, const std::vector<Bond> &bonds) {
+    rowStart.assign(n + 1, 0);
+    for (const Bond &b : bonds) {
+        rowStart[b.i + 1]++;
+        rowStart[b.j + 1]++;
+    }
+    for (int i = 0; i < n; ++i) {
+        rowStart[i + 1] += rowStart[i];
+    }
+    partner.resize(rowStart[n]);
+    restLength.resize(rowStart[n]);
+    intact.assign(rowStart[n], 1);
+
+    std::vector<int> fill(rowStart.begin(), rowStart.end() - 1);
+    for (const Bond &b : bonds) {
+        partner[fill[b.i]] = b.j;
+        restLength[fill[b.i]++] = b.rest;
+        partner[fill[b.j]] = b.i;
+        restLength[fill[b.j]++] = b.rest;
+    }
+}
+
+void BondNetwork::connect(const matrix &positions, int first, int count, double maxLength) {
+    if (count <= 0) return;
+    // Bin the body on its own bounding box and bond the close pairs.
+    double minX = positions(first, X), maxX = minX;
+    double minY = positions(first, Y), maxY = minY;
+    for (int i = first; i < first + count; ++i) {
+        minX = std::min(minX, positions(i, X));
+        maxX = std::max(maxX, positions(i, X));
+        minY = std::min(minY, positions(i, Y));
+        maxY = std::max(maxY, positions(i, Y));
+    }
+    matrix local(count, DIMENSION);
+    for (int i = 0; i < count; ++i) {
+        local(i, X) = positions(first + i, X) - minX;
+        local(i, Y) = positions(first + i, Y) - minY;
+    }
+    CellGrid grid(static_cast<float>(maxX - minX + maxLength), static_cast<float>(maxY - minY + maxLength),
+                  static_cast<float>(maxLength), false);
+    grid.build(local);
+
+    std::vector<std::vector<Bond>> found(pool.size());
+    forEachCellPair(grid, pool, [&](int i, int j, unsigned thread) {
+        double dx = local(j, X) - local(i, X);
+        double dy = local(j, Y) - local(i, Y);
+        double d = std::sqrt(dx * dx + dy * dy);
+        if (d >= maxLength || d == 0.0) return;
+        found[thread].push_back({first + std::min(i, j), first + std::max(i, j), static_cast<float>(d)});
+    });
+
+    std::vector<Bond> bonds = intactBonds();
+    for (const auto &list : found) {
+        bonds.insert(bonds.end(), list.begin(), list.end());
+    }
+    buildRows(positions.rows, bonds);
+}
+
+void BondNetwork::apply(const matrix &positions, matrix &velocities, double dt) {
+    int n = static_cast<int>(rowStart.size()) - 1;
+    if (n <= 0 || dt <= 0.0) return;
+    const double *x = positions.data.data();
+    double *v = velocities.data.data();
+    deltaV.resize(2 * n);
+
+    // Gather: each particle reads its bonds and writes only its own correction.
+    // Both copies of a bond see the same length, so they break together.
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            double sumX = 0.0, sumY = 0.0;
+            int degree = 0;
+            for (int k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+                if (!intact[k]) continue;
+                int j = partner[k];
+                double dx = x[2 * j + X] - x[2 * i + X];
+                double dy = x[2 * j + Y] - x[2 * i + Y];
+                double d = std::sqrt(dx * dx + dy * dy);
+                double stretch = d - restLength[k];
+                if (std::fabs(stretch) > breakStrain * restLength[k]) {
+                    intact[k] = 0;
+                    continue;
+                }
+                if (d == 0.0) continue;
+                double nx = dx / d, ny = dy / d;
+                double closing = (v[2 * j + X] - v[2 * i + X]) * nx + (v[2 * j + Y] - v[2 * i + Y]) * ny;
+                // i takes half of the pair's correction; j does the mirror image.
+                double push = 0.5 * (stiffness * stretch / dt + damping * closing);
+                sumX += push * nx;
+                sumY += push * ny;
+                degree++;
+            }
+            double scale = degree > 0 ? 1.0 / degree : 0.0;
+            deltaV[2 * i] = sumX * scale;
+            deltaV[2 * i + 1] = sumY * scale;
+        }
+    });
+
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            v[2 * i + X] += deltaV[2 * i];
+            v[2 * i + Y] += deltaV[2 * i + 1];
+        }
+    });
+}
+
+double BondNetwork::maxStrain(const matrix &positions) const {
+    double worst = 0.0;
+    int n = static_cast<int>(rowStart.size()) - 1;
+    for (int i = 0; i < n; ++i) {
+        for (int k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+            if (!intact[k]) continue;
+            int j = partner[k];
+            double dx = positions(j, X) - positions(i, X);
+            double dy = positions(j, Y) - positions(i, Y);
+            double d = std::sqrt(dx * dx + dy * dy);
+            worst = std::max(worst, std::fabs(d - restLength[k]) / restLength[k]);
+        }
+    }
+    return worst;
+}
+
+void BondNetwork::multiply(const matrix &in, matrix &out) {
+    int n = static_cast<int>(rowStart.size()) - 1;
+    const double *p = in.data.data();
+    double *q = out.data.data();
+    const double *s = blocks.data.data();
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            double sumX = p[2 * i + X], sumY = p[2 * i + Y];
+            for (int k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+                if (!intact[k]) continue;
+                int j = partner[k];
+                double dx = p[2 * i + X] - p[2 * j + X];
+                double dy = p[2 * i + Y] - p[2 * j + Y];
+                sumX += s[4 * k] * dx + s[4 * k + 1] * dy;
+                sumY += s[4 * k + 2] * dx + s[4 * k + 3] * dy;
+            }
+            q[2 * i + X] = sumX;
+            q[2 * i + Y] = sumY;
+        }
+    });
+}
+
+void BondNetwork::precondition(const matrix &in, matrix &out) {
+    const double *p = in.data.data();
+    double *q = out.data.data();
+    const double *d = diagInverse.data.data();
+    pool.parallelFor(in.rows, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            q[2 * i + X] = d[4 * i] * p[2 * i + X] + d[4 * i + 1] * p[2 * i + Y];
+            q[2 * i + Y] = d[4 * i + 2] * p[2 * i + X] + d[4 * i + 3] * p[2 * i + Y];
+        }
+    });
+}
+
+void BondNetwork::solveImplicit(const matrix &positions, matrix &velocities, double dt) {
+    int n = static_cast<int>(rowStart.size()) - 1;
+    if (n <= 0 || dt <= 0.0) return;
+    if (blocks.rows != static_cast<int>(partner.size())) {
+        blocks = matrix(static_cast<int>(partner.size()), 4);
+    }
+    if (rhs.rows != n) {
+        diagInverse = matrix(n, 4);
+        rhs = matrix(n, DIMENSION);
+        solution = matrix(n, DIMENSION);
+        residual = matrix(n, DIMENSION);
+        aux = matrix(n, DIMENSION);
+        search = matrix(n, DIMENSION);
+    }
+    const double *x = positions.data.data();
+    const double *v = velocities.data.data();
+    double *s = blocks.data.data();
+    double *b = rhs.data.data();
+    double *dInv = diagInverse.data.data();
+    const double ks = implicitStiffness, kd = implicitDamping;
+
+    // Assemble row by row; particles have unit mass. Bond k of row i contributes
+    // S = dt^2 K + dt kd n n^T to both the diagonal and (negated) the off-diagonal
+    // block, where K = ks (n n^T + max(0, 1 - L/d) (I - n n^T)) drops the
+    // compressive part of the geometric stiffness to keep the system definite.
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            double dxx = 1.0, dxy = 0.0, dyy = 1.0;
+            double bx = 0.0, by = 0.0;
+            for (int k = rowStart[i]; k < rowStart[i + 1]; ++k) {
+                s[4 * k] = s[4 * k + 1] = s[4 * k + 2] = s[4 * k + 3] = 0.0;
+                if (!intact[k]) continue;
+                int j = partner[k];
+                double ex = x[2 * j + X] - x[2 * i + X];
+                double ey = x[2 * j + Y] - x[2 * i + Y];
+                double d = std::sqrt(ex * ex + ey * ey);
+                double stretch = d - restLength[k];
+                if (std::fabs(stretch) > breakStrain * restLength[k]) {
+                    intact[k] = 0;
+                    continue;
+                }
+                if (d == 0.0) continue;
+                double nx = ex / d, ny = ey / d;
+                double ratio = std::max(0.0, 1.0 - restLength[k] / d);
+                double kxx = ks * (nx * nx + ratio * (1.0 - nx * nx));
+                double kxy = ks * (nx * ny * (1.0 - ratio));
+                double kyy = ks * (ny * ny + ratio * (1.0 - ny * ny));
+
+                double rvx = v[2 * j + X] - v[2 * i + X];
+                double rvy = v[2 * j + Y] - v[2 * i + Y];
+                double closing = rvx * nx + rvy * ny;
+                double force = ks * stretch + kd * closing;
+                bx += dt * (force * nx + dt * (kxx * rvx + kxy * rvy));
+                by += dt * (force * ny + dt * (kxy * rvx + kyy * rvy));
+
+                double sxx = dt * dt * kxx + dt * kd * nx * nx;
+                double sxy = dt * dt * kxy + dt * kd * nx * ny;
+                double syy = dt * dt * kyy + dt * kd * ny * ny;
+                s[4 * k] = sxx;
+                s[4 * k + 1] = s[4 * k + 2] = sxy;
+                s[4 * k + 3] = syy;
+                dxx += sxx;
+                dxy += sxy;
+                dyy += syy;
+            }
+            b[2 * i + X] = bx;
+            b[2 * i + Y] = by;
+            double det = dxx * dyy - dxy * dxy;
+            dInv[4 * i] = dyy / det;
+            dInv[4 * i + 1] = dInv[4 * i + 2] = -dxy / det;
+            dInv[4 * i + 3] = dxx / det;
+        }
+    });
+
+    // Preconditioned conjugate gradient, as in the FLIP pressure solve, started
+    // from last frame's dv: in a body moving smoothly it changes little between
+    // frames, so the solve only has to correct it.
+    int size = 2 * n;
+    double tolerance = BOND_PCG_TOLERANCE * std::abs(rhs.data[cblas_idamax(size, rhs.data.data(), 1)]);
+    iterations = 0;
+    converged = true;
+    if (tolerance == 0.0) {
+        solution.zero();
+    } else {
+        multiply(solution, aux);
+        residual.copy(rhs);
+        cblas_daxpy(size, -1.0, aux.data.data(), 1, residual.data.data(), 1);
+        converged = std::abs(residual.data[cblas_idamax(size, residual.data.data(), 1)]) <= tolerance;
+    }
+    if (!converged) {
+        precondition(residual, search);
+        double sigma = cblas_ddot(size, search.data.data(), 1, residual.data.data(), 1);
+
+        while (iterations < BOND_PCG_ITERATIONS) {
+            ++iterations;
+            multiply(search, aux);
+            double denom = cblas_ddot(size, search.data.data(), 1, aux.data.data(), 1);
+            if (denom == 0.0) break;
+            double alpha = sigma / denom;
+            cblas_daxpy(size, alpha, search.data.data(), 1, solution.data.data(), 1);
+            cblas_daxpy(size, -alpha, aux.data.data(), 1, residual.data.data(), 1);
+            if (std::abs(residual.data[cblas_idamax(size, residual.data.data(), 1)]) <= tolerance) {
+                converged = true;
+                break;
+            }
+
+            precondition(residual, aux);
+            double sigmaNew = cblas_ddot(size, aux.data.data(), 1, residual.data.data(), 1);
+            double beta = sigmaNew / sigma;
+            sigma = sigmaNew;
+            double *p = search.data.data();
+            const double *z = aux.data.data();
+            pool.parallelFor(size, [&](int start, int end) {
+                for (int c = start; c < end; ++c) p[c] = z[c] + beta * p[c];
+            });
+        }
+        if (!converged) unconvergedCount++;
+    }
+
+    cblas_daxpy(size, 1.0, solution.data.data(), 1, velocities.data.data(), 1);
+}
+
+void BondNetwork::permute(const std::vector<int> &order) {
+    int n = static_cast<int>(rowStart.size()) - 1;
+    if (n <= 0) return;
+    std::vector<int> newIndex(n);
+    for (int k = 0; k < n; ++k) {
+        newIndex[order[k]] = k;
+    }
+
+    std::vector<int> newStart(n + 1, 0);
+    for (int k = 0; k < n; ++k) {
+        int old = order[k];
+        int kept = 0;
+        for (int b = rowStart[old]; b < rowStart[old + 1]; ++b) kept += intact[b];
+        newStart[k + 1] = newStart[k] + kept;
+    }
+    std::vector<int> newPartner(newStart[n]);
+    std::vector<float> newRest(newStart[n]);
+
+    // Rows are independent, so they are moved in parallel and kept sorted by
+    // partner, which keeps the gather in apply() walking memory forwards.
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int k = start; k < end; ++k) {
+            int old = order[k];
+            int out = newStart[k];
+            for (int b = rowStart[old]; b < rowStart[old + 1]; ++b) {
+                if (!intact[b]) continue;
+                int p = newIndex[partner[b]];
+                float rest = restLength[b];
+                int pos = out++;
+                while (pos > newStart[k] && newPartner[pos - 1] > p) {
+                    newPartner[pos] = newPartner[pos - 1];
+                    newRest[pos] = newRest[pos - 1];
+                    pos--;
+                }
+                newPartner[pos] = p;
+                newRest[pos] = rest;
+            }
+        }
+    });
+
+    rowStart.swap(newStart);
+    partner.swap(newPartner);
+    restLength.swap(newRest);
+    intact.assign(partner.size(), 1);
+    if (solution.rows == n) solution.permuteRows(order);
+}
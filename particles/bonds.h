@@ -0,0 +1,92 @@
+#ifndef BONDS_H
+#define BONDS_H
+
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Breakable distance bonds between particles, for soft bodies made of particles.
+// Bonds live in a CSR adjacency: the bonds of particle i are
+// [rowStart[i], rowStart[i + 1]) in partner / restLength / intact. Every bond is
+// stored in both endpoint rows, so each particle gathers its own correction and
+// writes only its own velocity: no locks, no colouring, any thread split.
+class BondNetwork {
+public:
+    explicit BondNetwork(ThreadPool &pool);
+
+    // Fraction of the stretch and of the relative velocity along each bond
+    // removed per frame (Jacobi averaged over the bonds of a particle).
+    double stiffness = BOND_STIFFNESS;
+    double damping = BOND_DAMPING;
+    // Bonds whose |length - rest| / rest exceeds this break for good.
+    double breakStrain = BOND_BREAK_STRAIN;
+
+    // Spring constant (per unit mass, 1/s^2) and damping (1/s) of the bonds in the
+    // implicit solve.
+    double implicitStiffness = BOND_IMPLICIT_STIFFNESS;
+    double implicitDamping = BOND_IMPLICIT_DAMPING;
+
+    // Bond every pair of particles in [first, first + count) closer than maxLength,
+    // at its current distance. Can be called once per body.
+    void connect(const matrix &positions, int first, int count, double maxLength);
+
+    // Pull bonded particles back towards their rest lengths through a velocity
+    // change for a frame of length dt, and break over-strained bonds.
+    void apply(const matrix &positions, matrix &velocities, double dt);
+
+    // Backward-Euler step of the bonds as stiff springs over a whole frame:
+    // (M - dt dF/dv - dt^2 dF/dx) dv = dt (F + dt dF/dx v) is assembled as 2x2
+    // blocks on the bond rows and solved with block-Jacobi preconditioned CG,
+    // starting from the previous solve's dv.
+    // Breaks over-strained bonds like apply().
+    void solveImplicit(const matrix &positions, matrix &velocities, double dt);
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k] (see matrix::permuteRows). Broken bonds are dropped.
+    void permute(const std::vector<int> &order);
+
+    // Intact bonds, and bonds broken since the last permute.
+    int bondCount() const;
+    int brokenCount() const;
+    double maxStrain(const matrix &positions) const;
+    // CG iterations used by the last implicit solve, whether it reached the
+    // tolerance within BOND_PCG_ITERATIONS, and how many solves have not.
+    int lastIterations() const { return iterations; }
+    bool lastConverged() const { return converged; }
+    long unconvergedSolves() const { return unconvergedCount; }
+
+private:
+    struct Bond {
+        int i, j;
+        float rest;
+    };
+
+    // Rebuild the CSR rows of n particles from a list of bonds with i < j.
+    void buildRows(int n, const std::vector<Bond> &bonds);
+    std::vector<Bond> intactBonds() const;
+    // out = (M - dt dF/dv - dt^2 dF/dx) in, and out = diagonal-block-inverse * in.
+    void multiply(const matrix &in, matrix &out);
+    void precondition(const matrix &in, matrix &out);
+
+    ThreadPool &pool;
+
+    std::vector<int> rowStart;
+    std::vector<int> partner;
+    std::vector<float> restLength;
+    std::vector<char> intact;
+
+    std::vector<double> deltaV;
+
+    // Implicit solve: one symmetric 2x2 block (xx, xy, yx, yy) per bond row entry
+    // and the inverted diagonal block per particle; the vectors are n x 2.
+    matrix blocks{0, 4};
+    matrix diagInverse{0, 4};
+    matrix rhs{0, DIMENSION}, solution{0, DIMENSION};
+    matrix residual{0, DIMENSION}, aux{0, DIMENSION}, search{0, DIMENSION};
+    int iterations = 0;
+    bool converged = true;
+    long unconvergedCount = 0;
+};
+
+#endif // BONDS_H
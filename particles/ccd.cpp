@@ -0,0 +1,213 @@
+#include "ccd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+SweptCollision::SweptCollision(float threshold, ThreadPool &pool) : threshold(threshold), pool(pool) {}
+
+// Cells holding the particles a sweep from (ox, oy) by (dx, dy) can reach: the
+// swept circle plus a cell of slack for their own motion.
+static void searchBox(double ox, double oy, double dx, double dy, float radius, CellKey &lo, CellKey &hi) {
+    float margin = 2.0f * radius + CELL_SIZE;
+    lo = computeCellKey(static_cast<float>(std::max(0.0, std::min(ox, ox + dx) - margin)),
+                        static_cast<float>(std::max(0.0, std::min(oy, oy + dy) - margin)));
+    hi = computeCellKey(static_cast<float>(std::max(ox, ox + dx) + margin),
+                        static_cast<float>(std::max(oy, oy + dy) + margin));
+}
+
+void SweptCollision::collectFast(const matrix &positions, const matrix &velocities, Particle **particles,
+                                 const CellMap &grid, const sf::Vector2u &windowSize, float dt) {
+    fast.clear();
+    start = positions.data;
+    double limit2 = static_cast<double>(threshold) * threshold / (static_cast<double>(dt) * dt);
+
+    // Summed velocity and count of every occupied cell.
+    cellFlow.clear();
+    for (const auto &cell : grid) {
+        CellFlow &flow = cellFlow[cell.first];
+        for (int j : cell.second) {
+            flow.vx += velocities(j, X);
+            flow.vy += velocities(j, Y);
+        }
+        flow.count = static_cast<int>(cell.second.size());
+    }
+
+    // The reference is the mean velocity of the particles in the cells around
+    // the path, weighted by count, so a few fast particles on the surface of a
+    // pile do not move it. Two neighbours within the threshold of it close by
+    // at most twice the threshold plus the change of the mean between them,
+    // which is small inside a stream falling together: it stays on the
+    // discrete path, and only its edges, where the mean changes, are swept.
+    for (int i = 0; i < positions.rows; ++i) {
+        if (!particles[i]->active) continue;
+        double vx = velocities(i, X), vy = velocities(i, Y);
+        double ox = positions(i, X), oy = positions(i, Y);
+        double dx = vx * dt, dy = vy * dt;
+        float radius = particles[i]->radius;
+
+        // Walls it would reach this step, which do not move.
+        bool hitsWall = (!PERIODIC_X && (std::min(ox, ox + dx) < radius || std::max(ox, ox + dx) > windowSize.x - radius)) ||
+                        (!PERIODIC_Y && (std::min(oy, oy + dy) < radius || std::max(oy, oy + dy) > windowSize.y - radius));
+        bool isFast = hitsWall && vx * vx + vy * vy > limit2;
+
+        if (!isFast) {
+            CellKey lo, hi;
+            searchBox(ox, oy, dx, dy, radius, lo, hi);
+            double sx = 0.0, sy = 0.0;
+            int count = 0;
+            for (int cx = lo.x; cx <= hi.x; ++cx) {
+                for (int cy = lo.y; cy <= hi.y; ++cy) {
+                    auto cell = cellFlow.find(CellKey{cx, cy});
+                    if (cell == cellFlow.end()) continue;
+                    sx += cell->second.vx;
+                    sy += cell->second.vy;
+                    count += cell->second.count;
+                }
+            }
+            double rx = count > 0 ? vx - sx / count : vx, ry = count > 0 ? vy - sy / count : vy;
+            isFast = rx * rx + ry * ry > limit2;
+        }
+        if (isFast) fast.push_back(i);
+    }
+}
+
+int SweptCollision::resolve(matrix &positions, matrix &velocities, Particle **particles, const CellMap &grid,
+                            const sf::Vector2u &windowSize) {
+    const long long SERIAL = 9;
+    const int TILE_LIMIT = 1 << 20;
+
+    // Sort the sweeps by colour and tile; those reaching past the ring of tiles
+    // around their own get the last, serial colour.
+    fastCount = static_cast<int>(fast.size());
+    order.clear();
+    for (int i : fast) {
+        double ox = start[2 * i + X], oy = start[2 * i + Y];
+        CellKey lo, hi;
+        searchBox(ox, oy, positions(i, X) - ox, positions(i, Y) - oy, particles[i]->radius, lo, hi);
+        CellKey home = computeCellKey(static_cast<float>(std::max(0.0, ox)), static_cast<float>(std::max(0.0, oy)));
+        int tx = home.x / TILE_CELLS, ty = home.y / TILE_CELLS;
+        bool local = tx < TILE_LIMIT && ty < TILE_LIMIT &&
+                     lo.x >= (tx - 1) * TILE_CELLS && hi.x < (tx + 2) * TILE_CELLS &&
+                     lo.y >= (ty - 1) * TILE_CELLS && hi.y < (ty + 2) * TILE_CELLS;
+        long long key = local ? (static_cast<long long>(tx % 3 * 3 + ty % 3) << 40) |
+                                (static_cast<long long>(tx) << 20) | ty
+                              : SERIAL << 40;
+        order.emplace_back(key, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t first = 0;
+    for (long long colour = 0; colour < SERIAL; ++colour) {
+        tileStart.clear();
+        size_t last = first;
+        for (; last < order.size() && order[last].first >> 40 == colour; ++last) {
+            if (last == first || order[last].first != order[last - 1].first) tileStart.push_back(static_cast<int>(last));
+        }
+        tileStart.push_back(static_cast<int>(last));
+        int tiles = static_cast<int>(tileStart.size()) - 1;
+        if (tiles > 0) {
+            pool.parallelFor(tiles, [&](int begin, int end) {
+                for (int t = begin; t < end; ++t) {
+                    for (int k = tileStart[t]; k < tileStart[t + 1]; ++k) {
+                        sweep(order[k].second, positions, velocities, particles, grid, windowSize);
+                    }
+                }
+            });
+        }
+        first = last;
+    }
+    for (size_t k = first; k < order.size(); ++k) {
+        sweep(order[k].second, positions, velocities, particles, grid, windowSize);
+    }
+    return fastCount;
+}
+
+void SweptCollision::sweep(int i, matrix &positions, matrix &velocities, Particle **particles, const CellMap &grid,
+                           const sf::Vector2u &windowSize) {
+    enum Hit { NONE, WALL_X, WALL_Y, PARTICLE };
+
+    float radius = particles[i]->radius;
+    double ox = start[2 * i + X], oy = start[2 * i + Y];
+    double dx = positions(i, X) - ox;
+    double dy = positions(i, Y) - oy;
+
+    double tBest = 1.0;
+    Hit hit = NONE;
+    int other = -1;
+
+    // Walls; particles already outside are left to handleBoundaryCollision.
+    auto wall = [&](double from, double delta, double limit, Hit kind) {
+        if (delta == 0.0) return;
+        double t = (limit - from) / delta;
+        if (t >= 0.0 && t < tBest) { tBest = t; hit = kind; }
+    };
+    // Periodic axes have no walls.
+    if (!PERIODIC_X && ox >= radius && ox <= windowSize.x - radius) {
+        wall(ox, dx, dx < 0 ? radius : windowSize.x - radius, WALL_X);
+    }
+    if (!PERIODIC_Y && oy >= radius && oy <= windowSize.y - radius) {
+        wall(oy, dy, dy < 0 ? radius : windowSize.y - radius, WALL_Y);
+    }
+
+    // Particles binned in every cell the sweep can reach, moving from their own
+    // start points, which already account for earlier responses this step.
+    CellKey lo, hi;
+    searchBox(ox, oy, dx, dy, radius, lo, hi);
+    for (int cx = lo.x; cx <= hi.x; ++cx) {
+        for (int cy = lo.y; cy <= hi.y; ++cy) {
+            auto cell = grid.find(CellKey{cx, cy});
+            if (cell == grid.end()) continue;
+            for (int j : cell->second) {
+                if (j == i) continue;
+                double jdx = positions(j, X) - start[2 * j + X];
+                double jdy = positions(j, Y) - start[2 * j + Y];
+                double rx = ox - start[2 * j + X];
+                double ry = oy - start[2 * j + Y];
+                double wx = dx - jdx;
+                double wy = dy - jdy;
+                double radiusSum = radius + particles[j]->radius;
+                double b = rx * wx + ry * wy;
+                double c = rx * rx + ry * ry - radiusSum * radiusSum;
+                if (b >= 0.0 || c < 0.0) continue;  // separating, or already overlapping
+                double w2 = wx * wx + wy * wy;
+                double disc = b * b - w2 * c;
+                if (disc < 0.0) continue;
+                double t = c / (-b + std::sqrt(disc));
+                if (t < tBest) { tBest = t; hit = PARTICLE; other = j; }
+            }
+        }
+    }
+
+    if (hit == NONE) return;
+
+    // Stop at the time of impact and respond like the discrete path would.
+    positions(i, X) = ox + dx * tBest;
+    positions(i, Y) = oy + dy * tBest;
+    if (hit == WALL_X) {
+        velocities(i, X) = -velocities(i, X);
+    } else if (hit == WALL_Y) {
+        velocities(i, Y) = -velocities(i, Y) * (1 - ENTROPY);
+    } else {
+        int j = other;
+        double nx = start[2 * j + X] + (positions(j, X) - start[2 * j + X]) * tBest - positions(i, X);
+        double ny = start[2 * j + Y] + (positions(j, Y) - start[2 * j + Y]) * tBest - positions(i, Y);
+        double distance = std::sqrt(nx * nx + ny * ny);
+        if (distance == 0.0) return;
+        nx /= distance;
+        ny /= distance;
+        double relVel = (velocities(i, X) - velocities(j, X)) * nx + (velocities(i, Y) - velocities(j, Y)) * ny;
+        if (relVel > 0.0) {
+            // The same mass-weighted shares as processCells.
+            double massSum = particles[i]->mass + particles[j]->mass;
+            double shareI = 2.0 * particles[j]->mass / massSum;
+            double shareJ = 2.0 * particles[i]->mass / massSum;
+            velocities(i, X) -= relVel * nx * (1 - ENTROPY) * shareI;
+            velocities(i, Y) -= relVel * ny * (1 - ENTROPY) * shareI;
+            velocities(j, X) += relVel * nx * (1 - ENTROPY) * shareJ;
+            velocities(j, Y) += relVel * ny * (1 - ENTROPY) * shareJ;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include <SFML/Graphics.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "cellkey.h"
+#include "matrix.h"
+#include "particle.h"
+#include "threadpool.h"
+
+// Continuous collision detection for the default mode. Particles whose step
+// displacement exceeds a threshold relative to a wall or to the mean motion of
+// the particles around their path are swept as circles from their old to their
+// new position and stopped at the first wall or particle they would tunnel
+// through; everything else stays on the discrete path in processCells. A
+// stream falling together moves little relative to itself, so only its edges
+// are swept.
+//
+// The sweeps run on the pool in nine colours of square tiles TILE_CELLS cells
+// wide: a particle whose search box stays within its tile and the ring of tiles
+// around it only touches particles binned there, so tiles of one colour, three
+// apart, never share a particle. Sweeps too long for that run alone at the end.
+class SweptCollision {
+public:
+    SweptCollision(float threshold, ThreadPool &pool);
+
+    // Remember the particles about to move further than the threshold relative to
+    // a wall or to the particles binned in grid (last frame's bins) around their
+    // path, and where every particle starts. Call before the positions are
+    // integrated.
+    void collectFast(const matrix &positions, const matrix &velocities, Particle **particles, const CellMap &grid,
+                     const sf::Vector2u &windowSize, float dt);
+
+    // Sweep every collected particle against the walls and the particles binned in
+    // grid (last frame's bins) along its path. Call after integrating, before the
+    // grid is rebuilt. Returns the number of particles that took the CCD path.
+    int resolve(matrix &positions, matrix &velocities, Particle **particles, const CellMap &grid,
+                const sf::Vector2u &windowSize);
+
+    int lastCount() const { return fastCount; }
+
+    static const int TILE_CELLS = 4;
+
+private:
+    void sweep(int i, matrix &positions, matrix &velocities, Particle **particles, const CellMap &grid,
+               const sf::Vector2u &windowSize);
+
+    float threshold;
+    ThreadPool &pool;
+    int fastCount = 0;
+    std::vector<int> fast;
+    std::vector<double> start;                      // (x, y) of every particle before the step
+    struct CellFlow {
+        double vx = 0.0, vy = 0.0;   // summed velocity
+        int count = 0;
+    };
+    std::unordered_map<CellKey, CellFlow> cellFlow;  // per occupied cell
+    std::vector<std::pair<long long, int>> order;   // (colour, tile) key and particle, per sweep
+    std::vector<int> tileStart;                     // runs of order in one tile
+};
+
+#endif // CCD_H
@@ -0,0 +1,54 @@
+#ifndef CELLKEY_H
+#define CELLKEY_H
+
+#include <cmath>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "defs.h"
+
+struct CellKey {
+    int x, y;
+    bool operator==(const CellKey &other) const { return x == other.x && y == other.y; }
+};
+
+namespace std {
+    template <>
+    struct hash<CellKey> {
+        std::size_t operator()(const CellKey &k) const {
+            return (std::hash<int>()(k.x) ^ (std::hash<int>()(k.y) << 1));
+        }
+    };
+}
+
+// Sparse collision grid used by the default mode: occupied cells to particle indices.
+typedef std::unordered_map<CellKey, std::vector<int>> CellMap;
+
+inline CellKey computeCellKey(float x, float y) {
+    return CellKey{static_cast<int>(x) / CELL_SIZE, static_cast<int>(y) / CELL_SIZE};
+}
+
+// Periodic domains: number of collision cells across each axis. The window must be
+// a whole number of cells along periodic axes so the seam lines up with a cell edge.
+#define CELLS_X (WINDOW_X / CELL_SIZE)
+#define CELLS_Y (WINDOW_Y / CELL_SIZE)
+static_assert(!PERIODIC_X || WINDOW_X % CELL_SIZE == 0, "periodic x needs WINDOW_X to be a multiple of CELL_SIZE");
+static_assert(!PERIODIC_Y || WINDOW_Y % CELL_SIZE == 0, "periodic y needs WINDOW_Y to be a multiple of CELL_SIZE");
+
+// Neighbouring cell key, wrapped across periodic axes.
+template <bool PeriodicX, bool PeriodicY>
+inline CellKey neighborCellKey(const CellKey &key, int dx, int dy) {
+    CellKey n{ key.x + dx, key.y + dy };
+    if constexpr (PeriodicX) n.x = (n.x + CELLS_X) % CELLS_X;
+    if constexpr (PeriodicY) n.y = (n.y + CELLS_Y) % CELLS_Y;
+    return n;
+}
+
+// Shortest separation along periodic axes (minimum image).
+template <bool PeriodicX, bool PeriodicY>
+inline void minimumImage(float &dx, float &dy) {
+    if constexpr (PeriodicX) dx -= WINDOW_X * std::round(dx / WINDOW_X);
+    if constexpr (PeriodicY) dy -= WINDOW_Y * std::round(dy / WINDOW_Y);
+}
+
+#endif // CELLKEY_H
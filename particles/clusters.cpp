@@ -0,0 +1,121 @@
+#include "clusters.h"
+#include "cellkey.h"
+
+#include <algorithm>
+
+#define X 0
+#define Y 1
+
+ContactClusters::ContactClusters(int count, ThreadPool &pool)
+    : count(count), pool(pool), parent(count), links(pool.size()), label(count, -1), sizes(count, 0)
+{
+}
+
+int ContactClusters::find(int i) {
+    // Path halving: point each visited node at its grandparent on the way up.
+    while (true) {
+        int p = parent[i].load(std::memory_order_relaxed);
+        if (p == i) return i;
+        int gp = parent[p].load(std::memory_order_relaxed);
+        if (gp != p) parent[i].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        i = gp;
+    }
+}
+
+void ContactClusters::unite(unsigned thread, int i, int j) {
+    while (true) {
+        int a = find(i), b = find(j);
+        if (a == b) return;
+        if (a > b) std::swap(a, b);
+        // Link root b under a unless another thread has linked b meanwhile.
+        int expected = b;
+        if (parent[b].compare_exchange_strong(expected, a, std::memory_order_relaxed)) {
+            links[thread].push_back((static_cast<std::uint64_t>(i) << 32) | static_cast<std::uint32_t>(j));
+            return;
+        }
+    }
+}
+
+void ContactClusters::begin(const matrix &positions, const char *active, const float *radius) {
+    const double *x = positions.data.data();
+    bool keep = valid;
+    if (keep) {
+        std::atomic<bool> broken(false);
+        pool.parallelFor(static_cast<int>(links.size()), [&](int start, int end) {
+            for (int t = start; t < end && !broken.load(std::memory_order_relaxed); ++t) {
+                for (std::uint64_t link : links[t]) {
+                    int i = static_cast<int>(link >> 32), j = static_cast<int>(link & 0xffffffffu);
+                    float dx = static_cast<float>(x[2 * j + X] - x[2 * i + X]);
+                    float dy = static_cast<float>(x[2 * j + Y] - x[2 * i + Y]);
+                    minimumImage<PERIODIC_X, PERIODIC_Y>(dx, dy);
+                    float radiusSum = radius[i] + radius[j];
+                    if (!active[i] || !active[j] || dx * dx + dy * dy >= radiusSum * radiusSum) {
+                        broken.store(true, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+            }
+        });
+        keep = !broken.load();
+    }
+    if (!keep) {
+        pool.parallelFor(count, [&](int start, int end) {
+            for (int i = start; i < end; ++i) parent[i].store(i, std::memory_order_relaxed);
+        });
+        for (auto &buffer : links) buffer.clear();
+    }
+    reused = keep;
+    valid = true;
+}
+
+void ContactClusters::finish(const matrix &positions, const char *active) {
+    const double *x = positions.data.data();
+    pool.parallelFor(count, [&](int start, int end) {
+        for (int i = start; i < end; ++i) label[i] = active[i] ? find(i) : -1;
+    });
+
+    // Sizes and centroids per root; positions are taken relative to the root so
+    // clusters across a periodic edge get a centroid near them.
+    std::vector<int> &size = sizes;
+    std::fill(size.begin(), size.end(), 0);
+    std::vector<double> sumX(count, 0.0), sumY(count, 0.0);
+    for (int i = 0; i < count; ++i) {
+        int r = label[i];
+        if (r < 0) continue;
+        float dx = static_cast<float>(x[2 * i + X] - x[2 * r + X]);
+        float dy = static_cast<float>(x[2 * i + Y] - x[2 * r + Y]);
+        minimumImage<PERIODIC_X, PERIODIC_Y>(dx, dy);
+        size[r]++;
+        sumX[r] += dx;
+        sumY[r] += dy;
+    }
+
+    found.clear();
+    histogram.clear();
+    for (int r = 0; r < count; ++r) {
+        if (size[r] == 0) continue;
+        int bin = 0;
+        while ((2 << bin) <= size[r]) bin++;
+        if (bin >= static_cast<int>(histogram.size())) histogram.resize(bin + 1, 0);
+        histogram[bin]++;
+        if (size[r] < 2) continue;
+        found.push_back({ r, size[r], x[2 * r + X] + sumX[r] / size[r], x[2 * r + Y] + sumY[r] / size[r] });
+    }
+    std::sort(found.begin(), found.end(), [](const Cluster &a, const Cluster &b) {
+        return a.size != b.size ? a.size > b.size : a.label < b.label;
+    });
+}
+
+void ContactClusters::permute(const std::vector<int> &order) {
+    std::vector<int> newIndex(count), old(label), oldSizes(sizes);
+    for (int k = 0; k < count; ++k) newIndex[order[k]] = k;
+    for (int k = 0; k < count; ++k) {
+        label[k] = old[order[k]] < 0 ? -1 : newIndex[old[order[k]]];
+        sizes[k] = 0;
+    }
+    for (int k = 0; k < count; ++k) {
+        if (oldSizes[k] > 0) sizes[newIndex[k]] = oldSizes[k];
+    }
+    for (Cluster &c : found) c.label = newIndex[c.label];
+    valid = false;
+}
@@ -0,0 +1,68 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Clusters (agglomerates) of touching particles, labelled from the contacts the
+// collision pass finds. unite() is a lock-free union-find any contact thread may
+// call: roots are linked by compare-and-swap, always the larger index under the
+// smaller, so a cluster's label is its smallest particle index whatever order
+// the contacts come in.
+//
+// Only the contacts that linked two roots are kept; they span every cluster. If
+// all of them still touch at the next labelling, no cluster can have split, so
+// the forest is kept and that round's contacts only add to it. Otherwise it is
+// rebuilt from scratch.
+class ContactClusters {
+public:
+    struct Cluster { int label; int size; double cx, cy; };
+
+    ContactClusters(int count, ThreadPool &pool);
+
+    // Start a labelling round before the contact pass, with each particle's
+    // activity and radius.
+    void begin(const matrix &positions, const char *active, const float *radius);
+
+    // Contact between i and j on the given thread; safe to call concurrently.
+    void unite(unsigned thread, int i, int j);
+
+    // Label the particles and gather the clusters after the contact pass.
+    void finish(const matrix &positions, const char *active);
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k]. The forest is rebuilt at the next round.
+    void permute(const std::vector<int> &order);
+
+    // Per particle: the cluster label, -1 for inactive particles.
+    const std::vector<int> &labels() const { return label; }
+    // Particles in the cluster with the given label.
+    int sizeOf(int clusterLabel) const { return clusterLabel < 0 ? 0 : sizes[clusterLabel]; }
+    // Clusters of two or more particles of the last round, largest first.
+    const std::vector<Cluster> &clusters() const { return found; }
+    // Number of clusters with size in [2^k, 2^(k+1)).
+    const std::vector<int> &sizeDistribution() const { return histogram; }
+    // Whether the last round reused the previous forest.
+    bool incremental() const { return reused; }
+
+private:
+    int find(int i);
+
+    int count;
+    ThreadPool &pool;
+    std::vector<std::atomic<int>> parent;
+    std::vector<std::vector<std::uint64_t>> links;   // per thread, (i << 32) | j
+    bool valid = false;
+    bool reused = false;
+
+    std::vector<int> label;
+    std::vector<int> sizes;      // per label
+    std::vector<Cluster> found;
+    std::vector<int> histogram;
+};
+
+#endif // CLUSTERS_H
@@ -0,0 +1,127 @@
+#include "container.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+KinematicContainer::KinematicContainer(Shape shape, float cx, float cy, float halfWidth, float halfHeight)
+    : shape(shape), restX(cx), restY(cy), halfWidth(halfWidth), halfHeight(halfHeight),
+      cx(cx), cy(cy), angle(0.0)
+{
+    cellsX = WINDOW_X / CELL_SIZE + 1;
+    cellsY = WINDOW_Y / CELL_SIZE + 1;
+    nearCell.assign(cellsX * cellsY, 0);
+
+    if (shape == DRUM) {
+        const int segments = 64;
+        outline.setPointCount(segments);
+        for (int k = 0; k < segments; ++k) {
+            float a = 2.0f * 3.14159265f * k / segments;
+            outline.setPoint(k, sf::Vector2f(halfWidth * std::cos(a), halfWidth * std::sin(a)));
+        }
+    } else {
+        outline.setPointCount(4);
+        outline.setPoint(0, sf::Vector2f(-halfWidth, -halfHeight));
+        outline.setPoint(1, sf::Vector2f(halfWidth, -halfHeight));
+        outline.setPoint(2, sf::Vector2f(halfWidth, halfHeight));
+        outline.setPoint(3, sf::Vector2f(-halfWidth, halfHeight));
+    }
+    outline.setFillColor(sf::Color::Transparent);
+    outline.setOutlineColor(sf::Color(200, 200, 80));
+    outline.setOutlineThickness(2.0f);
+}
+
+double KinematicContainer::wallDistance(double x, double y, double &nx, double &ny) const {
+    double rx = x - cx, ry = y - cy;
+    if (shape == DRUM) {
+        double r = std::sqrt(rx * rx + ry * ry);
+        nx = r > 0.0 ? -rx / r : 0.0;
+        ny = r > 0.0 ? -ry / r : 0.0;
+        return halfWidth - r;
+    }
+    // Into the box frame, pick the nearest wall, and back out.
+    double cosA = std::cos(angle), sinA = std::sin(angle);
+    double lx = cosA * rx + sinA * ry;
+    double ly = -sinA * rx + cosA * ry;
+    double dx = halfWidth - std::fabs(lx);
+    double dy = halfHeight - std::fabs(ly);
+    double lnx = 0.0, lny = 0.0;
+    if (dx < dy) {
+        lnx = lx > 0.0 ? -1.0 : 1.0;
+    } else {
+        lny = ly > 0.0 ? -1.0 : 1.0;
+    }
+    nx = cosA * lnx - sinA * lny;
+    ny = sinA * lnx + cosA * lny;
+    return std::min(dx, dy);
+}
+
+void KinematicContainer::update(float time, float dt, float maxRadius) {
+    if (shape == NONE) return;
+    double phase = 2.0 * 3.14159265 * shakeFrequency * time;
+    double newX = restX + shakeX * std::sin(phase);
+    double newY = restY + shakeY * std::sin(phase);
+    double newAngle = spin * time + angleOffset;
+    if (started && dt > 0.0f) {
+        vx = (newX - cx) / dt;
+        vy = (newY - cy) / dt;
+        omega = (newAngle - angle) / dt;
+    }
+    cx = newX;
+    cy = newY;
+    angle = newAngle;
+    started = true;
+
+    outline.setPosition(sf::Vector2f(static_cast<float>(cx), static_cast<float>(cy)));
+    outline.setRotation(sf::radians(static_cast<float>(angle)));
+
+    // Cells whose centre is further inside than the half diagonal, a particle
+    // radius and this frame's wall travel cannot touch the walls.
+    double travel = (std::sqrt(vx * vx + vy * vy) + std::fabs(omega) * std::hypot(halfWidth, halfHeight)) * dt;
+    double reach = 0.7072 * CELL_SIZE + maxRadius + travel;
+    for (int y = 0; y < cellsY; ++y) {
+        for (int x = 0; x < cellsX; ++x) {
+            double nx, ny;
+            double d = wallDistance((x + 0.5) * CELL_SIZE, (y + 0.5) * CELL_SIZE, nx, ny);
+            nearCell[y * cellsX + x] = d < reach;
+        }
+    }
+}
+
+bool KinematicContainer::isNear(const CellKey &key) const {
+    if (shape == NONE) return false;
+    // Particles that left the window are always checked so they get pulled back.
+    if (key.x < 0 || key.x >= cellsX || key.y < 0 || key.y >= cellsY) return true;
+    return nearCell[key.y * cellsX + key.x];
+}
+
+bool KinematicContainer::collide(double *pos, double *vel, float radius) const {
+    bool hit = false;
+    // A second pass handles box corners, where two walls are crossed at once.
+    for (int pass = 0; pass < 2; ++pass) {
+        double nx, ny;
+        double d = wallDistance(pos[X], pos[Y], nx, ny);
+        if (d >= radius) break;
+        hit = true;
+        pos[X] += (radius - d) * nx;
+        pos[Y] += (radius - d) * ny;
+
+        // Response relative to the wall's own velocity at the contact.
+        double wallVx = vx - omega * (pos[Y] - cy);
+        double wallVy = vy + omega * (pos[X] - cx);
+        double relX = vel[X] - wallVx, relY = vel[Y] - wallVy;
+        double vn = relX * nx + relY * ny;
+        if (vn < 0.0) {
+            double tx = relX - vn * nx, ty = relY - vn * ny;
+            vel[X] -= (2.0 - ENTROPY) * vn * nx + CONTAINER_FRICTION * tx;
+            vel[Y] -= (2.0 - ENTROPY) * vn * ny + CONTAINER_FRICTION * ty;
+        }
+    }
+    return hit;
+}
+
+void KinematicContainer::draw(sf::RenderWindow &window) {
+    if (shape != NONE) window.draw(outline);
+}
@@ -0,0 +1,52 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "cellkey.h"
+#include "defs.h"
+
+// Moving container walls (box or drum) on a scripted transform: spin, plus a
+// sinusoidal shake of the centre, plus whatever angle the user drags in. Wall
+// velocity at a contact comes from the transform's motion over the frame, so
+// particles bounce off the walls relative to how fast they are moving.
+class KinematicContainer {
+public:
+    enum Shape { NONE = CONTAINER_NONE, BOX = CONTAINER_BOX, DRUM = CONTAINER_DRUM };
+
+    KinematicContainer(Shape shape, float cx, float cy, float halfWidth, float halfHeight);
+
+    Shape shape;
+    float spin = CONTAINER_SPIN;                 // rad/s
+    float shakeX = CONTAINER_SHAKE_X;            // amplitude, pixels
+    float shakeY = CONTAINER_SHAKE_Y;
+    float shakeFrequency = CONTAINER_SHAKE_FREQUENCY;  // Hz
+    // Extra rotation applied on top of the script (e.g. by dragging).
+    float angleOffset = 0.0f;
+
+    // Move to the transform at time t, deriving the wall velocity over dt, and
+    // flag the collision cells the walls can reach this frame.
+    void update(float time, float dt, float maxRadius);
+    bool isNear(const CellKey &key) const;
+
+    // Keep a particle inside; returns true on contact.
+    bool collide(double *pos, double *vel, float radius) const;
+
+    void draw(sf::RenderWindow &window);
+
+private:
+    // Distance from a world point to the walls, positive inside, with the inward
+    // normal of the nearest wall.
+    double wallDistance(double x, double y, double &nx, double &ny) const;
+
+    float restX, restY, halfWidth, halfHeight;
+    double cx, cy, angle;
+    double vx = 0.0, vy = 0.0, omega = 0.0;
+    bool started = false;
+
+    int cellsX, cellsY;
+    std::vector<char> nearCell;
+    sf::ConvexShape outline;
+};
+
+#endif // CONTAINER_H
@@ -16,4 +16,298 @@
 #define MOUSE_RADIUS 100.0f
 #define MOUSE_FORCE 1000.0f
 
+// Periodic boundaries per axis in the collision mode (0 = reflecting walls).
+#define PERIODIC_X 0
+#define PERIODIC_Y 0
+
+// Per-step displacement, relative to a wall or to the mean motion of the
+// particles around its path, above which a particle is swept (continuous
+// collision): a diameter, so two particles below it close by at most the two
+// diameters one needs to pass through the other without the two overlapping at
+// either end.
+#define CCD_THRESHOLD (2.0f * RADIUS)
+
+// Simulation modes.
+#define MODE_COLLISION 0
+#define MODE_FLIP 1
+#define MODE_MD 2
+#define MODE_EDMD 3
+#define MODE_XPBD 4
+#define MODE_DEM 5
+#define MODE_3D 6
+#define MODE_DPD 7
+#define MODE_BOIDS 8
+#define SIM_MODE MODE_COLLISION
+
+// PIC/FLIP fluid.
+#define FLIP_CELL_SIZE 4.0f
+#define FLIP_RATIO 0.95f
+#define FLIP_CFL 1.0f
+#define FLIP_MAX_SUBSTEPS 4
+#define FLIP_SLAB_ROWS 4
+#define FLIP_PCG_ITERATIONS 200
+#define FLIP_PCG_TOLERANCE 1e-4
+#define FLIP_EXTRAPOLATE_LAYERS 2
+
+// Thermostat for the collision and MD modes; THERMOSTAT_NONE keeps the plain
+// dynamics. The target kT per particle is MD_TEMPERATURE in the MD mode and
+// THERMOSTAT_TEMPERATURE (px^2/s^2 per unit mass) in the collision mode. Friction
+// is the Langevin rate and coupling the Berendsen time, both in the mode's time unit.
+#define THERMOSTAT_NONE 0
+#define THERMOSTAT_LANGEVIN 1
+#define THERMOSTAT_BERENDSEN 2
+#define THERMOSTAT THERMOSTAT_NONE
+#define THERMOSTAT_TEMPERATURE 100.0
+#define THERMOSTAT_FRICTION 1.0
+#define THERMOSTAT_COUPLING 0.1
+#define THERMOSTAT_SEED 12345
+
+// Lennard-Jones MD. Sigma is in pixels; cutoff and skin in units of sigma;
+// the timestep in units of tau = sigma * sqrt(m / epsilon).
+#define MD_SIGMA 3.0f
+#define MD_EPSILON 1.0f
+#define MD_MASS 1.0f
+#define MD_CUTOFF 2.5f
+#define MD_SKIN 0.3f
+#define MD_TIMESTEP 0.005f
+#define MD_STEPS_PER_FRAME 4
+#define MD_TEMPERATURE 1.0f
+#define MD_BENCH_PARTICLES 64000
+#define MD_BENCH_STEPS 200
+
+// Event-driven hard discs (cells must be at least one diameter).
+#define EDMD_CELL_SIZE 4.0f
+#define EDMD_RESTITUTION 1.0f
+#define EDMD_SPEED 50.0f
+
+// XPBD contacts. The margin (in diameters) widens the contact search so pairs
+// that close during a substep are still solved. Each substep runs at least
+// XPBD_ITERATIONS sweeps and up to XPBD_MAX_ITERATIONS while a contact overlaps
+// by more than XPBD_TOLERANCE radii. Many short substeps beat many sweeps: the
+// overlap gravity adds in a substep falls with its length squared, so a shallow
+// pile meets the tolerance in one sweep and the hundred-row bench pile in
+// about twenty-three.
+#define XPBD_SUBSTEPS 32
+#define XPBD_MAX_SUBSTEPS 64
+#define XPBD_ITERATIONS 1
+#define XPBD_MAX_ITERATIONS 32
+#define XPBD_TOLERANCE 0.01
+#define XPBD_COMPLIANCE 0.0
+#define XPBD_CONTACT_MARGIN 0.5f
+
+// Discrete-element granular mode (Hertz-Mindlin with Coulomb friction).
+// Stiffness is per unit overlap^1.5; damping is relative to critical.
+#define DEM_MASS 1.0
+#define DEM_STIFFNESS 1.0e7
+#define DEM_SHEAR_RATIO 0.2857
+#define DEM_DAMPING 0.3
+#define DEM_FRICTION 0.5
+#define DEM_SUBSTEPS 64
+#define DEM_MAX_FRAME_TIME (1.0 / 60.0)
+#define DEM_MAX_CONTACTS 8
+
+// Bonded soft bodies in the collision mode: BOND_BODIES (0 for none) square
+// blocks of particles with bonds to their lattice neighbours and diagonals.
+// Particles are re-sorted by cell every BOND_SORT_INTERVAL frames (0 disables)
+// and the bonds follow.
+#define BOND_BODIES 0
+#define BOND_BODY_SIDE 40
+#define BOND_SPACING 1.0f
+#define BOND_RANGE 1.5f
+#define BOND_STIFFNESS 0.5
+#define BOND_DAMPING 0.3
+#define BOND_BREAK_STRAIN 0.5
+#define BOND_SORT_INTERVAL 30
+// Backward-Euler springs instead of the per-frame relaxation above; stiffness is
+// per unit mass (1/s^2), far beyond what an explicit step at the frame time holds.
+// Off by default: at this stiffness the block-Jacobi CG needs ~220 iterations to
+// reach the tolerance, so most solves stop at BOND_PCG_ITERATIONS (bench implicit
+// counts them).
+#define BOND_IMPLICIT 0
+#define BOND_IMPLICIT_STIFFNESS 1.0e6
+#define BOND_IMPLICIT_DAMPING 20.0
+#define BOND_PCG_ITERATIONS 50
+#define BOND_PCG_TOLERANCE 1e-4
+#define BOND_BENCH_SIDE 600
+#define BOND_BENCH_FRAMES 100
+
+// Shape-matched clusters in the collision mode: SHAPE_CLUSTERS (0 for none)
+// square blocks placed after the bonded bodies. Stiffness 1 is rigid;
+// deformation blends in the linear fit.
+#define SHAPE_CLUSTERS 0
+#define SHAPE_CLUSTER_SIDE 10
+#define SHAPE_STIFFNESS 1.0
+#define SHAPE_DEFORMATION 0.0
+#define SHAPE_BENCH_CLUSTERS 5000
+#define SHAPE_BENCH_FRAMES 200
+
+// Convex rigid polygons in the collision mode: with POLYGON_DEMO, a mixer paddle
+// near the floor and a few loose bodies. Density is mass per pixel^2 (particles
+// keep their own mass and radius); the mixer turns in rad/s.
+#define POLYGON_DEMO 0
+#define POLYGON_DENSITY 1.0
+#define POLYGON_RESTITUTION 0.2
+#define POLYGON_MIXER_SPEED 1.5
+
+// Static obstacles from a distance field: with SDF_DEMO, a funnel of two ramps
+// and a peg. SDF_SPACING is the node spacing in pixels.
+#define SDF_DEMO 0
+#define SDF_SPACING 2.0f
+
+// Moving container in the collision mode: a tumbling drum or a spinning/shaking
+// box around the window centre. Half height is unused by the drum.
+#define CONTAINER_NONE 0
+#define CONTAINER_BOX 1
+#define CONTAINER_DRUM 2
+#define CONTAINER_SHAPE CONTAINER_NONE
+#define CONTAINER_HALF_WIDTH 380.0f
+#define CONTAINER_HALF_HEIGHT 250.0f
+#define CONTAINER_SPIN 0.5f
+#define CONTAINER_SHAKE_X 0.0f
+#define CONTAINER_SHAKE_Y 0.0f
+#define CONTAINER_SHAKE_FREQUENCY 2.0f
+#define CONTAINER_FRICTION 0.2
+
+// Dissipative particle dynamics in a periodic box. The cutoff is in pixels; the
+// repulsion a is in kT / rc, the friction gamma in m / tau and the timestep in
+// tau = rc sqrt(m / kT) (Groot-Warren water: a = 25, gamma = 4.5, dt = 0.04).
+#define DPD_CUTOFF 7.0f
+#define DPD_REPULSION 25.0
+#define DPD_FRICTION 4.5
+#define DPD_TEMPERATURE 1.0
+#define DPD_TIMESTEP 0.04
+#define DPD_LAMBDA 0.65
+#define DPD_STEPS_PER_FRAME 4
+#define DPD_SEED 2024
+#define DPD_BENCH_PARTICLES 60000
+#define DPD_BENCH_STEPS 200
+
+// Boids in a periodic box (the window in the boids mode). Distances are in
+// pixels, speeds in px/s; alignment is a rate (1/s), cohesion a spring rate
+// (1/s^2) and separation the strength of the 1 / d push. The field of view is
+// the cosine of the half angle around the heading (-1 sees all around). The
+// bench keeps the window's density in a box sized for its agent count.
+// BOIDS_LANES is the width of the steering loop's accumulator blocks (8 floats
+// fill an AVX register).
+#define BOIDS_AGENTS 250000
+#define BOIDS_RADIUS 6.0f
+#define BOIDS_SEPARATION_RADIUS 2.0f
+#define BOIDS_SEPARATION 100.0f
+#define BOIDS_ALIGNMENT 2.0f
+#define BOIDS_COHESION 4.0f
+#define BOIDS_FIELD_OF_VIEW -0.5f
+#define BOIDS_MIN_SPEED 40.0f
+#define BOIDS_MAX_SPEED 120.0f
+#define BOIDS_SEED 7
+#define BOIDS_LANES 8
+#define BOIDS_BENCH_AGENTS 1000000
+#define BOIDS_BENCH_STEPS 50
+
+// Adaptive resolution in the collision mode, with ADAPTIVE: particles that stay
+// within ADAPTIVE_REST_DISTANCE of one spot for ADAPTIVE_REST_FRAMES frames
+// merge, up to ADAPTIVE_MAX_MERGE per ADAPTIVE_MERGE_CELL-wide cell, and split
+// again when they leave that spot, move faster than ADAPTIVE_SPLIT_SPEED, have
+// their velocity jump by ADAPTIVE_IMPACT_SPEED in a frame, or are near the
+// mouse. Limits are kept per ADAPTIVE_REGION_SIZE region.
+#define ADAPTIVE 0
+#define ADAPTIVE_MAX_MERGE 4
+#define ADAPTIVE_MERGE_CELL 2.0f
+#define ADAPTIVE_REST_DISTANCE 1.0f
+#define ADAPTIVE_REST_FRAMES 30
+#define ADAPTIVE_SPLIT_SPEED 200.0f
+#define ADAPTIVE_IMPACT_SPEED 200.0f
+#define ADAPTIVE_REGION_SIZE 100.0f
+
+// Reactions in the collision mode: the free particles start as fuel and
+// oxidiser in equal parts. Touching fuel and oxidiser combine into one product
+// particle of twice the mass with REACTION_PROBABILITY per step, and fuel turns
+// into oxidiser at REACTION_DECAY_RATE per second. Reacting particles change
+// mass and radius, so adaptive resolution leaves all particles alone while on.
+#define REACTIONS 0
+#define REACTION_PROBABILITY 0.5f
+#define REACTION_DECAY_RATE 0.02f
+#define REACTION_SEED 99
+
+// Heat conduction in the collision mode. Touching particles exchange
+// THERMAL_CONDUCTANCE per second, per pixel of overlap and per degree of
+// difference; a particle holds THERMAL_SPECIFIC_HEAT per unit mass. A strip
+// THERMAL_SOURCE_DEPTH deep along the floor is held at THERMAL_HOT and one along
+// the top at THERMAL_COLD, pulling the particles inside towards them at
+// THERMAL_SOURCE_RATE per second. Particles lose THERMAL_BUOYANCY of their weight
+// per degree above THERMAL_AMBIENT and are coloured by temperature (over the
+// reaction colours).
+#define THERMAL 0
+#define THERMAL_CONDUCTANCE 50.0f
+#define THERMAL_SPECIFIC_HEAT 1.0f
+#define THERMAL_AMBIENT 300.0f
+#define THERMAL_HOT 1500.0f
+#define THERMAL_COLD 300.0f
+#define THERMAL_SOURCE_DEPTH 20.0f
+#define THERMAL_SOURCE_RATE 5.0f
+#define THERMAL_BUOYANCY 0.001f
+
+// Clusters of touching particles in the collision mode, labelled every
+// CLUSTER_INTERVAL frames (0 disables) from the contacts of that frame's
+// collision pass. With CLUSTER_COLORS, clusters of at least CLUSTER_MIN_SIZE
+// particles are painted by label (over the other colourings).
+#define CLUSTER_INTERVAL 0
+#define CLUSTER_MIN_SIZE 20
+#define CLUSTER_COLORS 1
+
+// Diagnostics of the collision mode, one row per frame: kinetic and gravitational
+// energy, momentum, granular temperature, wall pressures and contact overlaps.
+// Streamed to DIAGNOSTICS_FILE as CSV, or with DIAGNOSTICS_BINARY as doubles.
+#define DIAGNOSTICS 0
+#define DIAGNOSTICS_FILE "diagnostics.csv"
+#define DIAGNOSTICS_BINARY 0
+
+// Analyses of the collision mode, run in slices by a scheduler that spends at
+// most ANALYSIS_BUDGET_MS of each frame on them (at least one slice), each run
+// reading a snapshot of the frame it started on. Slices that walk the particles
+// take ANALYSIS_CHUNK of them. Curves and fields go to ANALYSIS_SERIES_FILE.
+#define ANALYSIS_BUDGET_MS 2.0
+#define ANALYSIS_CHUNK 16384
+#define ANALYSIS_SERIES_FILE "series.csv"
+
+// Pair structure: g(r) out to STRUCTURE_RMAX in STRUCTURE_BINS bins, sampled
+// every STRUCTURE_INTERVAL frames (0 disables) and averaged over the run, and
+// S(k) at STRUCTURE_KBINS wavenumbers up to STRUCTURE_KMAX from it. Both are
+// written every STRUCTURE_WRITE_INTERVAL samples. A sample is taken in
+// STRUCTURE_SLICES slices of the cells.
+#define STRUCTURE_INTERVAL 0
+#define STRUCTURE_RMAX 10.0f
+#define STRUCTURE_BINS 200
+#define STRUCTURE_KMAX 20.0f
+#define STRUCTURE_KBINS 200
+#define STRUCTURE_WRITE_INTERVAL 10
+#define STRUCTURE_SLICES 32
+
+// Number density and mean velocity on DENSITY_CELL cells every DENSITY_INTERVAL
+// frames (0 disables).
+#define DENSITY_INTERVAL 0
+#define DENSITY_CELL 20.0f
+
+// Checkpoint of positions, velocities and activity to CHECKPOINT_FILE every
+// CHECKPOINT_INTERVAL frames (0 disables).
+#define CHECKPOINT_INTERVAL 0
+#define CHECKPOINT_FILE "checkpoint.bin"
+
+// Trajectory recording for the analyze tool: a frame every RECORD_INTERVAL
+// frames (0 disables) appended to RECORD_FILE.
+#define RECORD_INTERVAL 0
+#define RECORD_FILE "trajectory.bin"
+
+// 3D mode: box size and sphere radius in world units, drawn with the cube's
+// isometric projection scaled by D3_SCALE and depth sorted into buckets.
+#define D3_BOX_X 200.0f
+#define D3_BOX_Y 200.0f
+#define D3_BOX_Z 200.0f
+#define D3_RADIUS 2.0f
+#define D3_ITERATIONS 4
+#define D3_SCALE 1.6f
+#define D3_ORIGIN_Y 80.0f
+#define D3_DEPTH_BUCKETS 1024
+#define D3_BENCH_PARTICLES 60000
+#define D3_BENCH_STEPS 100
+
 #endif // DEFS_H
\ No newline at end of file
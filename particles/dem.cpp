@@ -0,0 +1,235 @@
+#include "dem.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+// Hertz-Mindlin force on a disc from one contact. n points from the disc towards
+// the other body, (vx, vy) is the relative velocity of the contact point (disc
+// minus other) and (shearX, shearY) the stored tangential stretch, updated in
+// place. Written with selects only so batches of contacts vectorise.
+static inline void hertzMindlin(double nx, double ny, double overlap, double vx, double vy,
+                                double &shearX, double &shearY, double dt, double radius, double mass,
+                                double &fx, double &fy, double &torque) {
+    double vn = vx * nx + vy * ny;
+    double tvx = vx - vn * nx;
+    double tvy = vy - vn * ny;
+
+    double kn = DEM_STIFFNESS * std::sqrt(overlap);
+    double kt = DEM_SHEAR_RATIO * kn;
+    double damping = DEM_DAMPING * std::sqrt(mass * kn);
+    double fn = std::max(0.0, kn * overlap + damping * vn);
+
+    // Rotate the stretch into the current tangent plane, then add this step's slip.
+    double drift = shearX * nx + shearY * ny;
+    shearX += tvx * dt - drift * nx;
+    shearY += tvy * dt - drift * ny;
+
+    double ftx = -kt * shearX - damping * tvx;
+    double fty = -kt * shearY - damping * tvy;
+    double ft = std::sqrt(ftx * ftx + fty * fty);
+    double limit = DEM_FRICTION * fn;
+    bool sliding = ft > limit;
+    double scale = sliding ? limit / ft : 1.0;
+    ftx *= scale;
+    fty *= scale;
+    // While sliding the spring only holds what friction allows.
+    shearX = sliding ? -ftx / kt : shearX;
+    shearY = sliding ? -fty / kt : shearY;
+
+    fx = -fn * nx + ftx;
+    fy = -fn * ny + fty;
+    torque = radius * (nx * fty - ny * ftx);
+}
+
+void GranularDEM::ContactBatch::clear() {
+    resize(0);
+}
+
+void GranularDEM::ContactBatch::resize(size_t n) {
+    for (auto *v : {&first, &second, &slot}) v->resize(n);
+    for (auto *v : {&nx, &ny, &overlap, &vx, &vy, &shearX, &shearY, &fx, &fy, &torque}) v->resize(n);
+}
+
+GranularDEM::GranularDEM(float width, float height, float radius, ThreadPool &pool)
+    : width(width), height(height), radius(radius),
+      grid(width, height, 2.0f * radius, false), pool(pool)
+{
+    mass = DEM_MASS;
+    inertia = 0.5 * mass * radius * radius;
+    batches.resize(pool.size());
+}
+
+int GranularDEM::activeContacts() const {
+    int total = 0;
+    for (int count : historyCount) total += count;
+    return total;
+}
+
+int GranularDEM::historySlot(int i, int j) {
+    int owner = std::min(i, j), partner = std::max(i, j);
+    int row = owner * capacity;
+    int count = historyCount[owner];
+    for (int k = 0; k < count; ++k) {
+        if (historyPartner[row + k] == partner) {
+            historyTouched[row + k] = 1;
+            return row + k;
+        }
+    }
+    if (count == capacity) return -1;  // table full: this contact runs without history
+    historyPartner[row + count] = partner;
+    historyTouched[row + count] = 1;
+    historyShear[2 * (row + count)] = 0.0;
+    historyShear[2 * (row + count) + 1] = 0.0;
+    historyCount[owner]++;
+    return row + count;
+}
+
+void GranularDEM::step(matrix &positions, matrix &velocities, double dt, double gravity) {
+    int n = positions.rows;
+    if (static_cast<int>(omega.size()) != n) {
+        omega.assign(n, 0.0);
+        historyCount.assign(n, 0);
+        historyPartner.assign(static_cast<size_t>(n) * capacity, -1);
+        historyTouched.assign(static_cast<size_t>(n) * capacity, 0);
+        historyShear.assign(static_cast<size_t>(n) * capacity * 2, 0.0);
+        wallShear.assign(static_cast<size_t>(n) * 8, 0.0);
+    }
+
+    // Explicit springs need a bounded substep; long frames run in slow motion.
+    double h = std::min(dt, DEM_MAX_FRAME_TIME) / DEM_SUBSTEPS;
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+    for (int s = 0; s < DEM_SUBSTEPS; ++s) {
+        force.assign(2 * n, 0.0);
+        torque.assign(n, 0.0);
+        grid.build(positions);
+        computeForces(positions, velocities, h);
+        computeWallForces(positions, velocities, h);
+        compactHistory();
+
+        pool.parallelFor(n, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                v[2 * i + X] += h * force[2 * i] / mass;
+                v[2 * i + Y] += h * (force[2 * i + 1] / mass + gravity);
+                omega[i] += h * torque[i] / inertia;
+                x[2 * i + X] += h * v[2 * i + X];
+                x[2 * i + Y] += h * v[2 * i + Y];
+            }
+        });
+    }
+}
+
+void GranularDEM::computeForces(const matrix &positions, const matrix &velocities, double dt) {
+    const double *x = positions.data.data();
+    const double *v = velocities.data.data();
+    const double diameter = 2.0 * radius;
+
+    for (int colorY = 0; colorY < 2; ++colorY) {
+        for (int colorX = 0; colorX < 3; ++colorX) {
+            forEachCellOfColor(grid, pool, colorX, colorY, [&](int cx, int cy, unsigned thread) {
+                ContactBatch &batch = batches[thread];
+                batch.clear();
+
+                // Gather the touching pairs of this home cell.
+                forEachPairOfCell(grid, cx, cy, [&](int i, int j) {
+                    double dx = x[2 * j + X] - x[2 * i + X];
+                    double dy = x[2 * j + Y] - x[2 * i + Y];
+                    double d2 = dx * dx + dy * dy;
+                    if (d2 >= diameter * diameter || d2 == 0.0) return;
+                    double d = std::sqrt(d2);
+                    double nx = dx / d, ny = dy / d;
+                    double spin = radius * (omega[i] + omega[j]);
+                    int slot = historySlot(i, j);
+
+                    batch.first.push_back(i);
+                    batch.second.push_back(j);
+                    batch.slot.push_back(slot);
+                    batch.nx.push_back(nx);
+                    batch.ny.push_back(ny);
+                    batch.overlap.push_back(diameter - d);
+                    batch.vx.push_back(v[2 * i + X] - v[2 * j + X] - spin * ny);
+                    batch.vy.push_back(v[2 * i + Y] - v[2 * j + Y] + spin * nx);
+                    batch.shearX.push_back(slot >= 0 ? historyShear[2 * slot] : 0.0);
+                    batch.shearY.push_back(slot >= 0 ? historyShear[2 * slot + 1] : 0.0);
+                });
+
+                size_t count = batch.first.size();
+                batch.fx.resize(count);
+                batch.fy.resize(count);
+                batch.torque.resize(count);
+                for (size_t k = 0; k < count; ++k) {
+                    hertzMindlin(batch.nx[k], batch.ny[k], batch.overlap[k], batch.vx[k], batch.vy[k],
+                                 batch.shearX[k], batch.shearY[k], dt, radius, mass,
+                                 batch.fx[k], batch.fy[k], batch.torque[k]);
+                }
+
+                // Scatter: equal and opposite forces, same-signed torques.
+                for (size_t k = 0; k < count; ++k) {
+                    int i = batch.first[k], j = batch.second[k];
+                    force[2 * i] += batch.fx[k];
+                    force[2 * i + 1] += batch.fy[k];
+                    force[2 * j] -= batch.fx[k];
+                    force[2 * j + 1] -= batch.fy[k];
+                    torque[i] += batch.torque[k];
+                    torque[j] += batch.torque[k];
+                    if (batch.slot[k] >= 0) {
+                        historyShear[2 * batch.slot[k]] = batch.shearX[k];
+                        historyShear[2 * batch.slot[k] + 1] = batch.shearY[k];
+                    }
+                }
+            });
+        }
+    }
+}
+
+void GranularDEM::computeWallForces(const matrix &positions, const matrix &velocities, double dt) {
+    const double *x = positions.data.data();
+    const double *v = velocities.data.data();
+    // Outward normals of the left, right, top and bottom walls.
+    static const double normals[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+
+    pool.parallelFor(positions.rows, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            double overlaps[4] = {
+                radius - x[2 * i + X], x[2 * i + X] + radius - width,
+                radius - x[2 * i + Y], x[2 * i + Y] + radius - height
+            };
+            for (int w = 0; w < 4; ++w) {
+                double *shear = &wallShear[8 * static_cast<size_t>(i) + 2 * w];
+                if (overlaps[w] <= 0.0) {
+                    shear[0] = shear[1] = 0.0;
+                    continue;
+                }
+                double nx = normals[w][0], ny = normals[w][1];
+                double spin = radius * omega[i];
+                double fx, fy, tq;
+                hertzMindlin(nx, ny, overlaps[w], v[2 * i + X] - spin * ny, v[2 * i + Y] + spin * nx,
+                             shear[0], shear[1], dt, radius, mass, fx, fy, tq);
+                force[2 * i] += fx;
+                force[2 * i + 1] += fy;
+                torque[i] += tq;
+            }
+        }
+    });
+}
+
+void GranularDEM::compactHistory() {
+    pool.parallelFor(static_cast<int>(historyCount.size()), [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            int row = i * capacity;
+            int kept = 0;
+            for (int k = 0; k < historyCount[i]; ++k) {
+                if (!historyTouched[row + k]) continue;
+                historyPartner[row + kept] = historyPartner[row + k];
+                historyShear[2 * (row + kept)] = historyShear[2 * (row + k)];
+                historyShear[2 * (row + kept) + 1] = historyShear[2 * (row + k) + 1];
+                historyTouched[row + kept] = 0;
+                kept++;
+            }
+            historyCount[i] = kept;
+        }
+    });
+}
@@ -0,0 +1,64 @@
+#ifndef DEM_H
+#define DEM_H
+
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Discrete-element granular mode. Discs carry an angular velocity and interact
+// through Hertz-Mindlin normal/tangential springs with viscous damping and a
+// Coulomb friction limit. The tangential spring stretch of every contact is kept
+// across frames in a per-particle table keyed by the partner index, which is
+// what lets piles hold an angle of repose.
+class GranularDEM {
+public:
+    GranularDEM(float width, float height, float radius, ThreadPool &pool);
+
+    // Advance by dt in DEM_SUBSTEPS explicit substeps.
+    void step(matrix &positions, matrix &velocities, double dt, double gravity);
+
+    const std::vector<double> &angularVelocities() const { return omega; }
+    int activeContacts() const;
+
+private:
+    // Contacts of one home cell, gathered so the force kernel runs branch free
+    // over contiguous arrays.
+    struct ContactBatch {
+        std::vector<int> first, second, slot;
+        std::vector<double> nx, ny, overlap, vx, vy, shearX, shearY;
+        std::vector<double> fx, fy, torque;
+        void clear();
+        void resize(size_t n);
+    };
+
+    int historySlot(int i, int j);
+    void computeForces(const matrix &positions, const matrix &velocities, double dt);
+    void computeWallForces(const matrix &positions, const matrix &velocities, double dt);
+    void compactHistory();
+
+    float width, height, radius;
+    double mass, inertia;
+    CellGrid grid;
+    ThreadPool &pool;
+
+    std::vector<double> omega;
+    std::vector<double> force;
+    std::vector<double> torque;
+
+    // Contact history: row min(i, j) holds partner max(i, j) with its tangential
+    // stretch. Both particles of a pair are in the colour's write set, so the row
+    // is updated without locks. Untouched entries are dropped after each substep.
+    int capacity = DEM_MAX_CONTACTS;
+    std::vector<int> historyCount;
+    std::vector<int> historyPartner;
+    std::vector<char> historyTouched;
+    std::vector<double> historyShear;
+    // Stretch against each of the four walls.
+    std::vector<double> wallShear;
+
+    std::vector<ContactBatch> batches;
+};
+
+#endif // DEM_H
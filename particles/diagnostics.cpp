@@ -0,0 +1,99 @@
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static const int COLUMNS = sizeof(Diagnostics::Row) / sizeof(double);
+static_assert(COLUMNS == 16, "header() names 16 columns");
+
+Diagnostics::Diagnostics(unsigned threads) : sums(threads) {}
+
+Diagnostics::~Diagnostics() {
+    if (file) std::fclose(file);
+    if (seriesFile) std::fclose(seriesFile);
+}
+
+const char *Diagnostics::header() {
+    return "step,time,particles,kinetic,potential,total,momentum_x,momentum_y,granular_temperature,"
+           "pressure_left,pressure_right,pressure_top,pressure_bottom,contacts,overlap_mean,overlap_max";
+}
+
+void Diagnostics::open(const std::string &path, Format format) {
+    if (file) std::fclose(file);
+    file = std::fopen(path.c_str(), format == BINARY ? "wb" : "w");
+    if (!file) {
+        throw std::runtime_error("Cannot open diagnostics file " + path);
+    }
+    this->format = format;
+    if (format == BINARY) std::fprintf(file, "PDIAG1 %d\n", COLUMNS);
+    std::fprintf(file, "%s\n", header());
+}
+
+const Diagnostics::Row &Diagnostics::end(long step, double time, double dt, double width, double height) {
+    Sums total;
+    for (Sums &s : sums) {
+        total.count += s.count;
+        total.mass += s.mass;
+        total.kinetic += s.kinetic;
+        total.potential += s.potential;
+        total.px += s.px;
+        total.py += s.py;
+        for (int w = 0; w < 4; ++w) total.wall[w] += s.wall[w];
+        total.contacts += s.contacts;
+        total.overlap += s.overlap;
+        total.overlapMax = std::max(total.overlapMax, s.overlapMax);
+        s = Sums();
+    }
+
+    row.step = static_cast<double>(step);
+    row.time = time;
+    row.particles = total.count;
+    row.kinetic = total.kinetic;
+    row.potential = total.potential;
+    row.total = total.kinetic + total.potential;
+    row.momentumX = total.px;
+    row.momentumY = total.py;
+    // <v^2> - <v>^2 over both components, mass weighted, halved for per dimension.
+    row.granularTemperature = 0.0;
+    if (total.mass > 0.0) {
+        double meanX = total.px / total.mass, meanY = total.py / total.mass;
+        row.granularTemperature = 0.5 * (2.0 * total.kinetic / total.mass - meanX * meanX - meanY * meanY);
+    }
+    double lengths[4] = { height, height, width, width };
+    for (int w = 0; w < 4; ++w) row.pressure[w] = dt > 0.0 ? total.wall[w] / (dt * lengths[w]) : 0.0;
+    row.contacts = total.contacts;
+    row.overlapMean = total.contacts > 0.0 ? total.overlap / total.contacts : 0.0;
+    row.overlapMax = total.overlapMax;
+
+    if (file) {
+        const double *values = &row.step;
+        if (format == BINARY) {
+            std::fwrite(values, sizeof(double), COLUMNS, file);
+        } else {
+            for (int c = 0; c < COLUMNS; ++c) std::fprintf(file, c == 0 ? "%.17g" : ",%.17g", values[c]);
+            std::fputc('\n', file);
+        }
+    }
+    return row;
+}
+
+void Diagnostics::openSeries(const std::string &path) {
+    if (seriesFile) std::fclose(seriesFile);
+    seriesFile = std::fopen(path.c_str(), "w");
+    if (!seriesFile) {
+        throw std::runtime_error("Cannot open diagnostics series file " + path);
+    }
+    std::fprintf(seriesFile, "step,series,x,value\n");
+}
+
+void Diagnostics::writeSeries(long step, const char *name, const std::vector<double> &x, const std::vector<double> &values) {
+    writeSeries(step, name, x, values, 0, std::min(x.size(), values.size()));
+}
+
+void Diagnostics::writeSeries(long step, const char *name, const std::vector<double> &x, const std::vector<double> &values,
+                              size_t first, size_t last) {
+    if (!seriesFile) return;
+    last = std::min(last, std::min(x.size(), values.size()));
+    for (size_t k = first; k < last; ++k) std::fprintf(seriesFile, "%ld,%s,%.9g,%.9g\n", step, name, x[k], values[k]);
+    std::fflush(seriesFile);
+}
@@ -0,0 +1,93 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "defs.h"
+
+// Physical diagnostics streamed one row per step, as a guard against changes
+// that alter the physics. The sums are fed from passes the step makes anyway:
+// the per-particle pass that applies the walls reports each particle and the
+// impulse the walls gave it, and the contact pass reports each contact's
+// overlap into its own thread's sums. end() reduces the sums and writes the row.
+//
+// CSV files have a header line and one line per step. Binary files start with
+// the line "PDIAG1 <columns>", then the CSV header line, then each step as that
+// many native doubles.
+//
+// Curves sampled now and then, such as g(r), go to a separate series file in
+// long CSV form: one line "step,series,x,value" per point.
+class Diagnostics {
+public:
+    enum Format { CSV, BINARY };
+    enum Wall { LEFT, RIGHT, TOP, BOTTOM };
+
+    struct Row {
+        double step, time, particles;
+        double kinetic, potential, total;
+        double momentumX, momentumY;
+        double granularTemperature;    // velocity variance about the mean, per dimension
+        double pressure[4];            // wall impulse per second per unit length
+        double contacts, overlapMean, overlapMax;
+    };
+
+    explicit Diagnostics(unsigned threads);
+    ~Diagnostics();
+
+    Diagnostics(const Diagnostics&) = delete;
+    Diagnostics& operator=(const Diagnostics&) = delete;
+
+    // Start streaming to path; throws std::runtime_error if it cannot be opened.
+    void open(const std::string &path, Format format);
+
+    // Particle of the given mass at height y (downwards) in a box of the given
+    // height under gravity g, with its velocity after the walls.
+    void addParticle(unsigned thread, double mass, double y, double vx, double vy, double height, double g) {
+        Sums &s = sums[thread];
+        s.count++;
+        s.mass += mass;
+        s.kinetic += 0.5 * mass * (vx * vx + vy * vy);
+        s.potential += mass * g * (height - y);
+        s.px += mass * vx;
+        s.py += mass * vy;
+    }
+    void addWallImpulse(unsigned thread, Wall wall, double impulse) { sums[thread].wall[wall] += impulse; }
+    void addContact(unsigned thread, float overlap) {
+        Sums &s = sums[thread];
+        s.contacts++;
+        s.overlap += overlap;
+        if (overlap > s.overlapMax) s.overlapMax = overlap;
+    }
+
+    // Reduce the step's sums over a width x height box, write the row and clear.
+    const Row &end(long step, double time, double dt, double width, double height);
+
+    const Row &last() const { return row; }
+
+    // Start the series file; throws std::runtime_error if it cannot be opened.
+    void openSeries(const std::string &path);
+    // Append the curve values over x as the named series at the given step.
+    void writeSeries(long step, const char *name, const std::vector<double> &x, const std::vector<double> &values);
+    // Only the points [first, last), for writing a long series in pieces.
+    void writeSeries(long step, const char *name, const std::vector<double> &x, const std::vector<double> &values,
+                     size_t first, size_t last);
+
+    static const char *header();
+
+private:
+    // One cache line or more per thread so the contact threads do not share lines.
+    struct alignas(64) Sums {
+        double count = 0.0, mass = 0.0, kinetic = 0.0, potential = 0.0, px = 0.0, py = 0.0;
+        double wall[4] = {};
+        double contacts = 0.0, overlap = 0.0, overlapMax = 0.0;
+    };
+
+    std::vector<Sums> sums;
+    Row row{};
+    std::FILE *file = nullptr;
+    std::FILE *seriesFile = nullptr;
+    Format format = CSV;
+};
+
+#endif // DIAGNOSTICS_H
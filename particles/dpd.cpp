@@ -0,0 +1,115 @@
+#include "dpd.h"
+#include "rng.h"
+#include "cblas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#define X 0
+#define Y 1
+
+DissipativeParticles::DissipativeParticles(float boxX, float boxY, double cutoff, double repulsion,
+                                           double friction, double temperature, ThreadPool &pool)
+    : cutoff(cutoff), kT(temperature), grid(boxX, boxY, static_cast<float>(cutoff), true), pool(pool)
+{
+    double tau = cutoff * std::sqrt(1.0 / kT);
+    this->repulsion = repulsion * kT / cutoff;
+    this->friction = friction / tau;
+    sigma = std::sqrt(2.0 * this->friction * kT);
+}
+
+void DissipativeParticles::initRandom(matrix &positions, matrix &velocities) const {
+    int n = positions.rows;
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<double> ux(0.0, grid.width), uy(0.0, grid.height);
+    std::normal_distribution<double> dist(0.0, std::sqrt(kT));
+    double px = 0.0, py = 0.0;
+    for (int i = 0; i < n; ++i) {
+        positions(i, X) = ux(gen);
+        positions(i, Y) = uy(gen);
+        velocities(i, X) = dist(gen);
+        velocities(i, Y) = dist(gen);
+        px += velocities(i, X);
+        py += velocities(i, Y);
+    }
+    for (int i = 0; i < n; ++i) {
+        velocities(i, X) -= px / n;
+        velocities(i, Y) -= py / n;
+    }
+}
+
+double DissipativeParticles::temperature(const matrix &velocities) const {
+    int n = static_cast<int>(velocities.data.size());
+    return n > 0 ? cblas_ddot(n, velocities.data.data(), 1, velocities.data.data(), 1) / n : 0.0;
+}
+
+void DissipativeParticles::computeForces(const matrix &positions, const matrix &velocities, double dt) {
+    const double *x = positions.data.data();
+    const double *v = velocities.data.data();
+    const double rc2 = cutoff * cutoff;
+    const double noise = sigma / std::sqrt(dt);
+    const double root3 = std::sqrt(3.0);
+    const std::uint64_t step = steps;
+
+    force.assign(positions.data.size(), 0.0);
+    grid.build(positions);
+    forEachCellPair(grid, pool, [&](int i, int j, unsigned) {
+        double dx = x[2 * j + X] - x[2 * i + X];
+        double dy = x[2 * j + Y] - x[2 * i + Y];
+        grid.minimumImage(dx, dy);
+        double r2 = dx * dx + dy * dy;
+        if (r2 >= rc2 || r2 == 0.0) return;
+        double r = std::sqrt(r2);
+        double ex = dx / r, ey = dy / r;
+        double w = 1.0 - r / cutoff;
+
+        // Uniform with unit variance is enough for DPD and cheaper than a normal.
+        std::uint64_t pair = (static_cast<std::uint64_t>(std::min(i, j)) << 32) | static_cast<std::uint64_t>(std::max(i, j));
+        double theta = root3 * (2.0 * toUniform(counterHash(seed, pair, step)) - 1.0);
+
+        double closing = (v[2 * j + X] - v[2 * i + X]) * ex + (v[2 * j + Y] - v[2 * i + Y]) * ey;
+        // Magnitude along e, positive pushing i away from j.
+        double f = repulsion * w - friction * w * w * closing + noise * w * theta;
+        force[2 * i + X] -= f * ex;
+        force[2 * i + Y] -= f * ey;
+        force[2 * j + X] += f * ex;
+        force[2 * j + Y] += f * ey;
+    });
+    steps++;
+}
+
+void DissipativeParticles::step(matrix &positions, matrix &velocities, double dt) {
+    int n = positions.rows;
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+    if (!forcesValid) {
+        computeForces(positions, velocities, dt);
+        forcesValid = true;
+    }
+
+    // Move, and predict the velocity the new dissipative forces should see.
+    if (predicted.rows != n) predicted = matrix(n, 2);
+    double *u = predicted.data.data();
+    const double lambda = DPD_LAMBDA;
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            for (int d = 0; d < 2; ++d) {
+                double f = force[2 * i + d];
+                x[2 * i + d] += dt * v[2 * i + d] + 0.5 * dt * dt * f;
+                u[2 * i + d] = v[2 * i + d] + lambda * dt * f;
+                v[2 * i + d] += 0.5 * dt * f;
+            }
+            grid.wrap(x[2 * i + X], x[2 * i + Y]);
+        }
+    });
+
+    computeForces(positions, predicted, dt);
+
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            v[2 * i + X] += 0.5 * dt * force[2 * i + X];
+            v[2 * i + Y] += 0.5 * dt * force[2 * i + Y];
+        }
+    });
+}
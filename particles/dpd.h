@@ -0,0 +1,49 @@
+#ifndef DPD_H
+#define DPD_H
+
+#include <cstdint>
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Dissipative particle dynamics in a periodic box (Groot & Warren). Pairs closer
+// than the cutoff rc feel, along their separation e and with w = 1 - r/rc,
+//   conservative  a w e,   dissipative  -gamma w^2 (e . v_ij) e,
+//   random        sigma w theta_ij / sqrt(dt) e,   sigma^2 = 2 gamma kT,
+// so the pair terms are a momentum-conserving thermostat. theta_ij is hashed
+// from (min(i, j), max(i, j), step) by the counter-based RNG: both particles see
+// the same number no matter which thread or cell visits the pair. Pairs come
+// from the shared cell grid and its conflict-free colouring.
+//
+// a is given in kT / rc and gamma in m / tau with tau = rc sqrt(m / kT); the
+// particle mass is 1.
+class DissipativeParticles {
+public:
+    DissipativeParticles(float boxX, float boxY, double cutoff, double repulsion, double friction,
+                         double temperature, ThreadPool &pool);
+
+    // Uniformly random positions with velocities for the temperature and no drift.
+    void initRandom(matrix &positions, matrix &velocities) const;
+
+    // One modified velocity-Verlet step (Groot-Warren, lambda = DPD_LAMBDA).
+    void step(matrix &positions, matrix &velocities, double dt);
+
+    double temperature(const matrix &velocities) const;
+    std::uint64_t seed = DPD_SEED;
+
+private:
+    void computeForces(const matrix &positions, const matrix &velocities, double dt);
+
+    double cutoff, kT, repulsion, friction, sigma;
+    CellGrid grid;
+    ThreadPool &pool;
+
+    std::uint64_t steps = 0;
+    std::vector<double> force;
+    matrix predicted{0, 2};         // velocities the new forces are evaluated at
+    bool forcesValid = false;
+};
+
+#endif // DPD_H
@@ -0,0 +1,213 @@
+#include "edmd.h"
+#include "defs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#define X 0
+#define Y 1
+
+static const double NEVER = std::numeric_limits<double>::infinity();
+
+HardSphereEDMD::HardSphereEDMD(float width, float height, float radius, float restitution, ThreadPool &pool)
+    : width(width), height(height), radius(radius), restitution(restitution), pool(pool)
+{
+    // Cells must be at least one diameter so only the 3x3 block can collide.
+    cellSize = std::max(EDMD_CELL_SIZE, 2.0f * radius);
+    nx = std::max(1, static_cast<int>(width / cellSize));
+    ny = std::max(1, static_cast<int>(height / cellSize));
+    cells.assign(nx * ny, {});
+}
+
+int HardSphereEDMD::cellIndex(double x, double y) const {
+    int cx = std::clamp(static_cast<int>(x / cellSize), 0, nx - 1);
+    int cy = std::clamp(static_cast<int>(y / cellSize), 0, ny - 1);
+    return cy * nx + cx;
+}
+
+void HardSphereEDMD::insertIntoCell(int i, int cell) {
+    cellOfParticle[i] = cell;
+    slotInCell[i] = static_cast<int>(cells[cell].size());
+    cells[cell].push_back(i);
+}
+
+void HardSphereEDMD::removeFromCell(int i) {
+    auto &members = cells[cellOfParticle[i]];
+    int last = members.back();
+    members[slotInCell[i]] = last;
+    slotInCell[last] = slotInCell[i];
+    members.pop_back();
+}
+
+void HardSphereEDMD::initGas(matrix &positions, matrix &velocities, double speed) {
+    int n = positions.rows;
+    int cols = static_cast<int>(std::ceil(std::sqrt(n * static_cast<double>(width) / height)));
+    int rows = (n + cols - 1) / cols;
+    double ax = width / cols;
+    double ay = height / rows;
+    double jitterX = std::max(0.0, 0.5 * (ax - 2.0 * radius));
+    double jitterY = std::max(0.0, 0.5 * (ay - 2.0 * radius));
+
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    for (int i = 0; i < n; ++i) {
+        positions(i, X) = (i % cols + 0.5) * ax + jitterX * unit(gen);
+        positions(i, Y) = (i / cols + 0.5) * ay + jitterY * unit(gen);
+        double angle = 3.14159265358979 * unit(gen);
+        velocities(i, X) = speed * std::cos(angle);
+        velocities(i, Y) = speed * std::sin(angle);
+    }
+    synced = false;
+}
+
+// Earliest event of particle i, assuming everything it can see is at its own
+// local time. Reads only, so all particles can be predicted in parallel.
+HardSphereEDMD::Event HardSphereEDMD::predict(int i, const matrix &positions, const matrix &velocities) const {
+    double t0 = localTime[i];
+    double x = positions(i, X), y = positions(i, Y);
+    double vx = velocities(i, X), vy = velocities(i, Y);
+    Event best{NEVER, i, NO_EVENT, counts[i], 0, -1};
+    auto consider = [&](double t, int partner, unsigned partnerCount, int target) {
+        t = t0 + std::max(0.0, t);
+        if (t < best.time) best = Event{t, i, partner, counts[i], partnerCount, target};
+    };
+
+    // Walls.
+    if (vx < 0) consider((radius - x) / vx, WALL_X, 0, -1);
+    if (vx > 0) consider((width - radius - x) / vx, WALL_X, 0, -1);
+    if (vy < 0) consider((radius - y) / vy, WALL_Y, 0, -1);
+    if (vy > 0) consider((height - radius - y) / vy, WALL_Y, 0, -1);
+
+    // Leaving the current cell.
+    int cell = cellOfParticle[i];
+    int cx = cell % nx, cy = cell / nx;
+    if (vx > 0 && cx < nx - 1) consider(((cx + 1) * cellSize - x) / vx, CELL_CROSSING, 0, cell + 1);
+    if (vx < 0 && cx > 0)      consider((cx * cellSize - x) / vx, CELL_CROSSING, 0, cell - 1);
+    if (vy > 0 && cy < ny - 1) consider(((cy + 1) * cellSize - y) / vy, CELL_CROSSING, 0, cell + nx);
+    if (vy < 0 && cy > 0)      consider((cy * cellSize - y) / vy, CELL_CROSSING, 0, cell - nx);
+
+    // Collisions with discs in the surrounding 3x3 cells.
+    double sigma2 = 4.0 * radius * radius;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            int ox = cx + dx, oy = cy + dy;
+            if (ox < 0 || ox >= nx || oy < 0 || oy >= ny) continue;
+            for (int j : cells[oy * nx + ox]) {
+                if (j == i) continue;
+                // Bring j forward to i's local time.
+                double lag = t0 - localTime[j];
+                double rx = positions(j, X) + velocities(j, X) * lag - x;
+                double ry = positions(j, Y) + velocities(j, Y) * lag - y;
+                double wx = velocities(j, X) - vx;
+                double wy = velocities(j, Y) - vy;
+                double b = rx * wx + ry * wy;
+                if (b >= 0.0) continue;
+                double w2 = wx * wx + wy * wy;
+                double c = rx * rx + ry * ry - sigma2;
+                double disc = b * b - w2 * c;
+                if (disc < 0.0) continue;
+                consider(c <= 0.0 ? 0.0 : c / (-b + std::sqrt(disc)), j, counts[j], -1);
+            }
+        }
+    }
+    return best;
+}
+
+void HardSphereEDMD::moveTo(int i, double t, matrix &positions, const matrix &velocities) {
+    double lag = t - localTime[i];
+    positions(i, X) += velocities(i, X) * lag;
+    positions(i, Y) += velocities(i, Y) * lag;
+    localTime[i] = t;
+}
+
+void HardSphereEDMD::resync(const matrix &positions, const matrix &velocities) {
+    int n = positions.rows;
+    localTime.assign(n, now);
+    counts.assign(n, 0);
+    cellOfParticle.assign(n, 0);
+    slotInCell.assign(n, 0);
+    for (auto &members : cells) members.clear();
+    for (int i = 0; i < n; ++i) {
+        insertIntoCell(i, cellIndex(positions(i, X), positions(i, Y)));
+    }
+
+    // Initial predictions are independent, so they are spread over the pool.
+    std::vector<Event> events(n);
+    pool.parallelFor(n, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            events[i] = predict(i, positions, velocities);
+        }
+    });
+    queue = std::priority_queue<Event, std::vector<Event>, Later>(Later(), std::move(events));
+    synced = true;
+}
+
+void HardSphereEDMD::advance(matrix &positions, matrix &velocities, double dt) {
+    if (!synced) resync(positions, velocities);
+    double target = now + dt;
+
+    // Events form a strict time order, so this loop is serial.
+    while (!queue.empty() && queue.top().time <= target) {
+        Event e = queue.top();
+        queue.pop();
+        int i = e.particle;
+        if (e.count != counts[i]) continue;  // superseded by a newer prediction
+
+        if (e.partner >= 0 && e.partnerCount != counts[e.partner]) {
+            // Partner changed course; i's own prediction is stale, redo it from now.
+            moveTo(i, e.time, positions, velocities);
+            Event next = predict(i, positions, velocities);
+            if (next.partner != NO_EVENT) queue.push(next);
+            continue;
+        }
+
+        eventCount++;
+        moveTo(i, e.time, positions, velocities);
+        if (e.partner >= 0) {
+            int j = e.partner;
+            moveTo(j, e.time, positions, velocities);
+            double nxv = positions(j, X) - positions(i, X);
+            double nyv = positions(j, Y) - positions(i, Y);
+            double len = std::sqrt(nxv * nxv + nyv * nyv);
+            if (len > 0.0) {
+                nxv /= len;
+                nyv /= len;
+                double approach = (velocities(i, X) - velocities(j, X)) * nxv
+                                + (velocities(i, Y) - velocities(j, Y)) * nyv;
+                double impulse = 0.5 * (1.0 + restitution) * approach;
+                velocities(i, X) -= impulse * nxv;
+                velocities(i, Y) -= impulse * nyv;
+                velocities(j, X) += impulse * nxv;
+                velocities(j, Y) += impulse * nyv;
+            }
+            collisionCount++;
+            counts[i]++;
+            counts[j]++;
+            Event next = predict(j, positions, velocities);
+            if (next.partner != NO_EVENT) queue.push(next);
+        } else if (e.partner == CELL_CROSSING) {
+            removeFromCell(i);
+            insertIntoCell(i, e.target);
+            crossingCount++;
+            counts[i]++;
+        } else if (e.partner == WALL_X) {
+            velocities(i, X) = -velocities(i, X);
+            counts[i]++;
+        } else if (e.partner == WALL_Y) {
+            velocities(i, Y) = -velocities(i, Y);
+            counts[i]++;
+        }
+        Event next = predict(i, positions, velocities);
+        if (next.partner != NO_EVENT) queue.push(next);
+    }
+
+    // Bring every particle to the frame time for drawing.
+    pool.parallelFor(positions.rows, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            moveTo(i, target, positions, velocities);
+        }
+    });
+    now = target;
+}
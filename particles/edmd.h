@@ -0,0 +1,76 @@
+#ifndef EDMD_H
+#define EDMD_H
+
+#include <queue>
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+
+// Event-driven hard-disc dynamics. Instead of stepping time and resolving overlaps,
+// the exact time of every collision, wall hit and cell crossing is predicted and
+// the system jumps from event to event, so fast contacts are never missed or
+// handled twice. Particles are advanced lazily: positions(i) holds particle i at
+// its own local time until advance() synchronises everything to the frame time.
+class HardSphereEDMD {
+public:
+    HardSphereEDMD(float width, float height, float radius, float restitution, ThreadPool &pool);
+
+    // Place non-overlapping discs on a jittered lattice with random directions.
+    void initGas(matrix &positions, matrix &velocities, double speed);
+
+    // Predict every particle's first event. Call after velocities are changed
+    // from outside (this is also done on the first advance()).
+    void resync(const matrix &positions, const matrix &velocities);
+
+    // Process all events up to now + dt and bring every particle to that time.
+    void advance(matrix &positions, matrix &velocities, double dt);
+
+    long long collisions() const { return collisionCount; }
+    long long cellCrossings() const { return crossingCount; }
+    long long eventsProcessed() const { return eventCount; }
+
+private:
+    // Partner >= 0 is a collision; the negative values are the other event kinds.
+    enum { CELL_CROSSING = -1, WALL_X = -2, WALL_Y = -3, NO_EVENT = -4 };
+
+    struct Event {
+        double time;
+        int particle;
+        int partner;
+        unsigned count;
+        unsigned partnerCount;
+        int target;  // destination cell of a crossing
+    };
+    struct Later {
+        bool operator()(const Event &a, const Event &b) const { return a.time > b.time; }
+    };
+
+    int cellIndex(double x, double y) const;
+    void insertIntoCell(int i, int cell);
+    void removeFromCell(int i);
+    Event predict(int i, const matrix &positions, const matrix &velocities) const;
+    void moveTo(int i, double t, matrix &positions, const matrix &velocities);
+
+    float width, height, radius, restitution;
+    int nx, ny;
+    float cellSize;
+    ThreadPool &pool;
+
+    double now = 0.0;
+    bool synced = false;
+    std::vector<double> localTime;
+    std::vector<unsigned> counts;
+
+    // Cell membership with O(1) removal; crossings move particles between cells.
+    std::vector<std::vector<int>> cells;
+    std::vector<int> cellOfParticle;
+    std::vector<int> slotInCell;
+
+    std::priority_queue<Event, std::vector<Event>, Later> queue;
+
+    long long collisionCount = 0;
+    long long crossingCount = 0;
+    long long eventCount = 0;
+};
+
+#endif // EDMD_H
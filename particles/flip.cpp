@@ -0,0 +1,342 @@
+#include "flip.h"
+#include "cblas.h"
+#include "defs.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+// Bilinear stencil on a grid of (countX x countY) nodes whose node (i, j) sits at
+// ((i + offsetX) * h, (j + offsetY) * h). Positions outside the grid are clamped.
+struct Stencil {
+    int i0, j0;
+    double fx, fy;
+};
+
+static inline Stencil makeStencil(double x, double y, float h, double offsetX, double offsetY,
+                                  int countX, int countY) {
+    double gx = std::clamp(x / h - offsetX, 0.0, static_cast<double>(countX - 1));
+    double gy = std::clamp(y / h - offsetY, 0.0, static_cast<double>(countY - 1));
+    Stencil s;
+    s.i0 = std::min(static_cast<int>(gx), countX - 2);
+    s.j0 = std::min(static_cast<int>(gy), countY - 2);
+    s.fx = gx - s.i0;
+    s.fy = gy - s.j0;
+    return s;
+}
+
+static inline double sample(const std::vector<double> &field, int stride, const Stencil &s) {
+    int k = s.j0 * stride + s.i0;
+    return (1 - s.fx) * (1 - s.fy) * field[k] + s.fx * (1 - s.fy) * field[k + 1]
+         + (1 - s.fx) * s.fy * field[k + stride] + s.fx * s.fy * field[k + stride + 1];
+}
+
+static inline void splat(std::vector<double> &field, std::vector<double> &weight, int stride,
+                         const Stencil &s, double value) {
+    int k = s.j0 * stride + s.i0;
+    double w00 = (1 - s.fx) * (1 - s.fy), w10 = s.fx * (1 - s.fy);
+    double w01 = (1 - s.fx) * s.fy, w11 = s.fx * s.fy;
+    field[k] += w00 * value;              weight[k] += w00;
+    field[k + 1] += w10 * value;          weight[k + 1] += w10;
+    field[k + stride] += w01 * value;     weight[k + stride] += w01;
+    field[k + stride + 1] += w11 * value; weight[k + stride + 1] += w11;
+}
+
+FlipSolver::FlipSolver(float width, float height, float cellSize, ThreadPool &pool)
+    : h(cellSize), width(width), height(height), pool(pool)
+{
+    nx = std::max(2, static_cast<int>(std::ceil(width / cellSize)));
+    ny = std::max(2, static_cast<int>(std::ceil(height / cellSize)));
+
+    int uCount = (nx + 1) * ny;
+    int vCount = nx * (ny + 1);
+    u.assign(uCount, 0.0);  uWeight.assign(uCount, 0.0); uSaved.assign(uCount, 0.0); uValid.assign(uCount, 0);
+    v.assign(vCount, 0.0);  vWeight.assign(vCount, 0.0); vSaved.assign(vCount, 0.0); vValid.assign(vCount, 0);
+
+    int cells = nx * ny;
+    cellType.assign(cells, AIR);
+    pressure.assign(cells, 0.0);
+    rhs.assign(cells, 0.0);
+    residual.assign(cells, 0.0);
+    aux.assign(cells, 0.0);
+    search.assign(cells, 0.0);
+    invDiag.assign(cells, 0.0);
+
+    int slabs = (ny + FLIP_SLAB_ROWS - 1) / FLIP_SLAB_ROWS;
+    slabStart.assign(slabs + 1, 0);
+}
+
+void FlipSolver::step(matrix &positions, matrix &velocities, float dt, float gravity) {
+    // Keep particles from crossing more than FLIP_CFL cells per substep.
+    int n = static_cast<int>(velocities.data.size());
+    double maxSpeed = n > 0 ? std::abs(velocities.data[cblas_idamax(n, velocities.data.data(), 1)]) : 0.0;
+    int substeps = static_cast<int>(std::ceil(maxSpeed * dt / (FLIP_CFL * h)));
+    substeps = std::clamp(substeps, 1, FLIP_MAX_SUBSTEPS);
+    float subDt = dt / substeps;
+
+    for (int s = 0; s < substeps; ++s) {
+        binParticles(positions);
+        transferToGrid(positions, velocities);
+        applyForces(subDt, gravity);
+        project(subDt);
+        extrapolate(u, uValid, nx + 1, ny);
+        extrapolate(v, vValid, nx, ny + 1);
+        transferToParticles(positions, velocities, subDt);
+    }
+}
+
+void FlipSolver::binParticles(const matrix &positions) {
+    int n = positions.rows;
+    int slabs = static_cast<int>(slabStart.size()) - 1;
+    particleSlab.resize(n);
+    slabOrder.resize(n);
+    std::fill(slabStart.begin(), slabStart.end(), 0);
+    std::fill(cellType.begin(), cellType.end(), AIR);
+
+    for (int p = 0; p < n; ++p) {
+        int i = std::clamp(static_cast<int>(positions(p, X) / h), 0, nx - 1);
+        int j = std::clamp(static_cast<int>(positions(p, Y) / h), 0, ny - 1);
+        cellType[cIndex(i, j)] = FLUID;
+        particleSlab[p] = j / FLIP_SLAB_ROWS;
+        slabStart[particleSlab[p] + 1]++;
+    }
+    for (int s = 0; s < slabs; ++s) {
+        slabStart[s + 1] += slabStart[s];
+    }
+    std::vector<int> fill(slabStart.begin(), slabStart.end() - 1);
+    for (int p = 0; p < n; ++p) {
+        slabOrder[fill[particleSlab[p]]++] = p;
+    }
+}
+
+void FlipSolver::transferToGrid(const matrix &positions, const matrix &velocities) {
+    std::fill(u.begin(), u.end(), 0.0);
+    std::fill(v.begin(), v.end(), 0.0);
+    std::fill(uWeight.begin(), uWeight.end(), 0.0);
+    std::fill(vWeight.begin(), vWeight.end(), 0.0);
+
+    // A particle in cell row j splats into grid rows j-1..j+1, so with slabs of at
+    // least two rows, slabs of equal parity write disjoint rows.
+    int slabs = static_cast<int>(slabStart.size()) - 1;
+    for (int parity = 0; parity < 2; ++parity) {
+        int count = (slabs - parity + 1) / 2;
+        pool.parallelFor(count, [&](int start, int end) {
+            for (int idx = start; idx < end; ++idx) {
+                int s = 2 * idx + parity;
+                for (int k = slabStart[s]; k < slabStart[s + 1]; ++k) {
+                    int p = slabOrder[k];
+                    double x = positions(p, X);
+                    double y = positions(p, Y);
+                    splat(u, uWeight, nx + 1, makeStencil(x, y, h, 0.0, 0.5, nx + 1, ny), velocities(p, X));
+                    splat(v, vWeight, nx, makeStencil(x, y, h, 0.5, 0.0, nx, ny + 1), velocities(p, Y));
+                }
+            }
+        });
+    }
+
+    pool.parallelFor(static_cast<int>(u.size()), [&](int start, int end) {
+        for (int k = start; k < end; ++k) {
+            uValid[k] = uWeight[k] > 0.0;
+            if (uValid[k]) u[k] /= uWeight[k];
+        }
+    });
+    pool.parallelFor(static_cast<int>(v.size()), [&](int start, int end) {
+        for (int k = start; k < end; ++k) {
+            vValid[k] = vWeight[k] > 0.0;
+            if (vValid[k]) v[k] /= vWeight[k];
+        }
+    });
+
+    // Fill the faces next to the particles so FLIP differences are taken against
+    // a smooth field rather than zeros.
+    extrapolate(u, uValid, nx + 1, ny);
+    extrapolate(v, vValid, nx, ny + 1);
+    uSaved = u;
+    vSaved = v;
+}
+
+void FlipSolver::applyForces(float dt, float gravity) {
+    pool.parallelFor(static_cast<int>(v.size()), [&](int start, int end) {
+        for (int k = start; k < end; ++k) {
+            v[k] += gravity * dt;
+        }
+    });
+
+    // Solid walls on the window edges.
+    for (int j = 0; j < ny; ++j) {
+        u[uIndex(0, j)] = 0.0;
+        u[uIndex(nx, j)] = 0.0;
+    }
+    for (int i = 0; i < nx; ++i) {
+        v[vIndex(i, 0)] = 0.0;
+        v[vIndex(i, ny)] = 0.0;
+    }
+}
+
+void FlipSolver::applyLaplacian(const std::vector<double> &in, std::vector<double> &out) {
+    // Rows of cells; air neighbours are Dirichlet (p = 0), walls are Neumann.
+    pool.parallelFor(ny, [&](int start, int end) {
+        for (int j = start; j < end; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                int c = cIndex(i, j);
+                if (cellType[c] != FLUID) {
+                    out[c] = 0.0;
+                    continue;
+                }
+                double sum = in[c] / invDiag[c];
+                if (i > 0 && cellType[c - 1] == FLUID) sum -= in[c - 1];
+                if (i < nx - 1 && cellType[c + 1] == FLUID) sum -= in[c + 1];
+                if (j > 0 && cellType[c - nx] == FLUID) sum -= in[c - nx];
+                if (j < ny - 1 && cellType[c + nx] == FLUID) sum -= in[c + nx];
+                out[c] = sum;
+            }
+        }
+    });
+}
+
+void FlipSolver::project(float dt) {
+    int cells = nx * ny;
+    double scale = h / dt;
+
+    // Right-hand side (negative divergence) and Jacobi preconditioner.
+    pool.parallelFor(ny, [&](int start, int end) {
+        for (int j = start; j < end; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                int c = cIndex(i, j);
+                pressure[c] = 0.0;
+                if (cellType[c] != FLUID) {
+                    rhs[c] = 0.0;
+                    invDiag[c] = 0.0;
+                    continue;
+                }
+                double div = u[uIndex(i + 1, j)] - u[uIndex(i, j)] + v[vIndex(i, j + 1)] - v[vIndex(i, j)];
+                rhs[c] = -div * scale;
+                int diag = (i > 0) + (i < nx - 1) + (j > 0) + (j < ny - 1);
+                invDiag[c] = diag > 0 ? 1.0 / diag : 0.0;
+            }
+        }
+    });
+
+    // Preconditioned conjugate gradient; vector updates go through BLAS like the
+    // integration step in main.
+    residual = rhs;
+    double tolerance = FLIP_PCG_TOLERANCE * std::max(1.0, std::abs(rhs[cblas_idamax(cells, rhs.data(), 1)]));
+    iterations = 0;
+    if (std::abs(residual[cblas_idamax(cells, residual.data(), 1)]) > tolerance) {
+        for (int c = 0; c < cells; ++c) search[c] = residual[c] * invDiag[c];
+        double sigma = cblas_ddot(cells, search.data(), 1, residual.data(), 1);
+
+        for (iterations = 1; iterations <= FLIP_PCG_ITERATIONS; ++iterations) {
+            applyLaplacian(search, aux);
+            double denom = cblas_ddot(cells, search.data(), 1, aux.data(), 1);
+            if (denom == 0.0) break;
+            double alpha = sigma / denom;
+            cblas_daxpy(cells, alpha, search.data(), 1, pressure.data(), 1);
+            cblas_daxpy(cells, -alpha, aux.data(), 1, residual.data(), 1);
+            if (std::abs(residual[cblas_idamax(cells, residual.data(), 1)]) <= tolerance) break;
+
+            // aux <- M^-1 r, then search <- aux + beta * search.
+            pool.parallelFor(cells, [&](int start, int end) {
+                for (int c = start; c < end; ++c) aux[c] = residual[c] * invDiag[c];
+            });
+            double sigmaNew = cblas_ddot(cells, aux.data(), 1, residual.data(), 1);
+            double beta = sigmaNew / sigma;
+            sigma = sigmaNew;
+            pool.parallelFor(cells, [&](int start, int end) {
+                for (int c = start; c < end; ++c) search[c] = aux[c] + beta * search[c];
+            });
+        }
+    }
+
+    // Subtract the pressure gradient from every face touching fluid.
+    double gradScale = dt / h;
+    pool.parallelFor(ny, [&](int start, int end) {
+        for (int j = start; j < end; ++j) {
+            for (int i = 1; i < nx; ++i) {
+                int left = cIndex(i - 1, j), right = cIndex(i, j);
+                int k = uIndex(i, j);
+                uValid[k] = cellType[left] == FLUID || cellType[right] == FLUID;
+                if (uValid[k]) u[k] -= gradScale * (pressure[right] - pressure[left]);
+            }
+            uValid[uIndex(0, j)] = 1;
+            uValid[uIndex(nx, j)] = 1;
+        }
+    });
+    pool.parallelFor(ny + 1, [&](int start, int end) {
+        for (int j = start; j < end; ++j) {
+            for (int i = 0; i < nx; ++i) {
+                int k = vIndex(i, j);
+                if (j == 0 || j == ny) {
+                    vValid[k] = 1;
+                    continue;
+                }
+                int below = cIndex(i, j - 1), above = cIndex(i, j);
+                vValid[k] = cellType[below] == FLUID || cellType[above] == FLUID;
+                if (vValid[k]) v[k] -= gradScale * (pressure[above] - pressure[below]);
+            }
+        }
+    });
+}
+
+void FlipSolver::extrapolate(std::vector<double> &field, std::vector<char> &valid, int fx, int fy) {
+    // Each pass only writes faces that were invalid and only reads faces that were
+    // valid, so rows can be processed in parallel.
+    std::vector<char> next(valid.size());
+    for (int pass = 0; pass < FLIP_EXTRAPOLATE_LAYERS; ++pass) {
+        pool.parallelFor(fy, [&](int start, int end) {
+            for (int j = start; j < end; ++j) {
+                for (int i = 0; i < fx; ++i) {
+                    int k = j * fx + i;
+                    next[k] = valid[k];
+                    if (valid[k]) continue;
+                    double sum = 0.0;
+                    int count = 0;
+                    if (i > 0 && valid[k - 1])       { sum += field[k - 1];  count++; }
+                    if (i < fx - 1 && valid[k + 1])  { sum += field[k + 1];  count++; }
+                    if (j > 0 && valid[k - fx])      { sum += field[k - fx]; count++; }
+                    if (j < fy - 1 && valid[k + fx]) { sum += field[k + fx]; count++; }
+                    if (count > 0) {
+                        field[k] = sum / count;
+                        next[k] = 1;
+                    } else {
+                        field[k] = 0.0;
+                    }
+                }
+            }
+        });
+        valid.swap(next);
+    }
+}
+
+void FlipSolver::transferToParticles(matrix &positions, matrix &velocities, float dt) {
+    const double margin = RADIUS;
+    pool.parallelFor(positions.rows, [&](int start, int end) {
+        for (int p = start; p < end; ++p) {
+            double x = positions(p, X);
+            double y = positions(p, Y);
+            Stencil su = makeStencil(x, y, h, 0.0, 0.5, nx + 1, ny);
+            Stencil sv = makeStencil(x, y, h, 0.5, 0.0, nx, ny + 1);
+
+            double picX = sample(u, nx + 1, su);
+            double picY = sample(v, nx, sv);
+            double flipX = velocities(p, X) + picX - sample(uSaved, nx + 1, su);
+            double flipY = velocities(p, Y) + picY - sample(vSaved, nx, sv);
+            double vx = FLIP_RATIO * flipX + (1.0 - FLIP_RATIO) * picX;
+            double vy = FLIP_RATIO * flipY + (1.0 - FLIP_RATIO) * picY;
+
+            x += vx * dt;
+            y += vy * dt;
+            if (x < margin)          { x = margin;          vx = 0.0; }
+            if (x > width - margin)  { x = width - margin;  vx = 0.0; }
+            if (y < margin)          { y = margin;          vy = 0.0; }
+            if (y > height - margin) { y = height - margin; vy = 0.0; }
+
+            positions(p, X) = x;
+            positions(p, Y) = y;
+            velocities(p, X) = vx;
+            velocities(p, Y) = vy;
+        }
+    });
+}
@@ -0,0 +1,61 @@
+#ifndef FLIP_H
+#define FLIP_H
+
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+
+// PIC/FLIP liquid solver. Particles carry the velocity field; each step it is
+// splatted onto a staggered (MAC) grid, made divergence free with a Jacobi
+// preconditioned conjugate gradient pressure solve, and the change is
+// interpolated back onto the particles. Works directly on the positions and
+// velocities matrices used by the rest of the simulation.
+class FlipSolver {
+public:
+    FlipSolver(float width, float height, float cellSize, ThreadPool &pool);
+
+    // Advance the particles stored in positions/velocities by dt.
+    void step(matrix &positions, matrix &velocities, float dt, float gravity);
+
+    // Iterations used by the last pressure solve.
+    int lastIterations() const { return iterations; }
+
+private:
+    enum CellType : char { AIR = 0, FLUID = 1 };
+
+    int uIndex(int i, int j) const { return j * (nx + 1) + i; }
+    int vIndex(int i, int j) const { return j * nx + i; }
+    int cIndex(int i, int j) const { return j * nx + i; }
+
+    void binParticles(const matrix &positions);
+    void transferToGrid(const matrix &positions, const matrix &velocities);
+    void applyForces(float dt, float gravity);
+    void project(float dt);
+    void applyLaplacian(const std::vector<double> &in, std::vector<double> &out);
+    void extrapolate(std::vector<double> &field, std::vector<char> &valid, int fx, int fy);
+    void transferToParticles(matrix &positions, matrix &velocities, float dt);
+
+    int nx, ny;
+    float h;
+    float width, height;
+    ThreadPool &pool;
+
+    // Staggered velocities: u on vertical faces ((nx+1) x ny), v on horizontal faces (nx x (ny+1)).
+    std::vector<double> u, v, uWeight, vWeight, uSaved, vSaved;
+    std::vector<char> uValid, vValid;
+    std::vector<char> cellType;
+
+    // Pressure solve storage, one entry per cell.
+    std::vector<double> pressure, rhs, residual, aux, search, invDiag;
+
+    // Particles sorted into horizontal slabs of FLIP_SLAB_ROWS cell rows.
+    // Slabs of the same parity never splat into the same grid row, so each
+    // parity is scattered in parallel without atomics.
+    std::vector<int> slabStart;
+    std::vector<int> slabOrder;
+    std::vector<int> particleSlab;
+
+    int iterations = 0;
+};
+
+#endif // FLIP_H
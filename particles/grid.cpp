@@ -0,0 +1,95 @@
+#include "grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#define X 0
+#define Y 1
+
+CellGrid::CellGrid(float width, float height, float minCellSize, bool periodic)
+    : CellGrid(width, height, minCellSize, periodic, periodic)
+{
+}
+
+CellGrid::CellGrid(float width, float height, float minCellSize, bool periodicX, bool periodicY)
+    : width(width), height(height), periodicX(periodicX), periodicY(periodicY)
+{
+    nx = std::max(1, static_cast<int>(width / minCellSize));
+    ny = std::max(1, static_cast<int>(height / minCellSize));
+    // Colour classes repeat every 3 cells in x and 2 in y; the wrap must not break that.
+    if (periodicX) nx -= nx % 3;
+    if (periodicY) ny -= ny % 2;
+    if ((periodicX && nx < 3) || (periodicY && ny < 4)) {
+        throw std::invalid_argument("Periodic domain too small for its cell size");
+    }
+    cellWidth = width / nx;
+    cellHeight = height / ny;
+    cellStart.assign(nx * ny + 1, 0);
+}
+
+int CellGrid::cellOf(double x, double y) const {
+    int cx = std::clamp(static_cast<int>(std::floor(x / cellWidth)), 0, nx - 1);
+    int cy = std::clamp(static_cast<int>(std::floor(y / cellHeight)), 0, ny - 1);
+    return cy * nx + cx;
+}
+
+int CellGrid::neighbor(int cx, int cy, int dx, int dy) const {
+    int x = cx + dx;
+    int y = cy + dy;
+    if (periodicX) {
+        x = (x + nx) % nx;
+    } else if (x < 0 || x >= nx) {
+        return -1;
+    }
+    if (periodicY) {
+        y = (y + ny) % ny;
+    } else if (y < 0 || y >= ny) {
+        return -1;
+    }
+    return y * nx + x;
+}
+
+void CellGrid::minimumImage(double &dx, double &dy) const {
+    if (periodicX) dx -= width * std::round(dx / width);
+    if (periodicY) dy -= height * std::round(dy / height);
+}
+
+void CellGrid::wrap(double &x, double &y) const {
+    if (periodicX) x -= width * std::floor(x / width);
+    if (periodicY) y -= height * std::floor(y / height);
+}
+
+void CellGrid::build(const matrix &positions) {
+    int n = positions.rows;
+    particleCell.resize(n);
+    for (int i = 0; i < n; ++i) {
+        particleCell[i] = cellOf(positions(i, X), positions(i, Y));
+    }
+    bucket();
+}
+
+void CellGrid::build(const float *x, const float *y, int n) {
+    particleCell.resize(n);
+    for (int i = 0; i < n; ++i) {
+        particleCell[i] = cellOf(x[i], y[i]);
+    }
+    bucket();
+}
+
+void CellGrid::bucket() {
+    int n = static_cast<int>(particleCell.size());
+    cellParticles.resize(n);
+    std::fill(cellStart.begin(), cellStart.end(), 0);
+
+    for (int i = 0; i < n; ++i) {
+        cellStart[particleCell[i] + 1]++;
+    }
+    for (int c = 0; c < nx * ny; ++c) {
+        cellStart[c + 1] += cellStart[c];
+    }
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        cellParticles[fill[particleCell[i]]++] = i;
+    }
+}
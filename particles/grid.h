@@ -0,0 +1,106 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+
+// Dense uniform cell list over a rectangular domain. Particles are bucketed with a
+// counting sort so the particles of cell c are
+// cellParticles[cellStart[c] .. cellStart[c + 1]).
+class CellGrid {
+public:
+    // Cells are at least minCellSize wide. Periodic axes round the cell count down
+    // so the six-colour pair traversal below stays conflict free across the wrap.
+    CellGrid(float width, float height, float minCellSize, bool periodic);
+    CellGrid(float width, float height, float minCellSize, bool periodicX, bool periodicY);
+
+    int nx, ny;
+    float width, height;
+    float cellWidth, cellHeight;
+    bool periodicX, periodicY;
+
+    std::vector<int> cellStart;
+    std::vector<int> cellParticles;
+    std::vector<int> particleCell;
+
+    // Rebuild the buckets from an (n x 2) positions matrix.
+    void build(const matrix &positions);
+
+    // Same, from separate x and y arrays of n positions (SoA state).
+    void build(const float *x, const float *y, int n);
+
+    int numCells() const { return nx * ny; }
+    int cellOf(double x, double y) const;
+
+    // Cell (cx + dx, cy + dy), wrapped across periodic axes; -1 when it lies outside.
+    int neighbor(int cx, int cy, int dx, int dy) const;
+
+    // Shortest separation along the periodic axes.
+    void minimumImage(double &dx, double &dy) const;
+
+    // Map a position back into the domain along the periodic axes.
+    void wrap(double &x, double &y) const;
+
+private:
+    // Counting sort of particleCell into cellStart and cellParticles.
+    void bucket();
+};
+
+// Offsets of the forward half of the 3x3 stencil; together with the home cell
+// every neighbouring cell pair is visited exactly once.
+static const int HALF_STENCIL[4][2] = { {1, 0}, {-1, 1}, {0, 1}, {1, 1} };
+
+// Visit every particle cell c of colour (colorX, colorY), where colours repeat
+// every 3 cells in x and 2 in y. A home cell plus its half stencil only touches
+// cells [cx-1, cx+1] x [cy, cy+1], so cells of one colour never share particles.
+template <typename Fn>
+void forEachCellOfColor(const CellGrid &grid, ThreadPool &pool, int colorX, int colorY, Fn &&fn) {
+    int countX = (grid.nx - colorX + 2) / 3;
+    int countY = (grid.ny - colorY + 1) / 2;
+    pool.parallelFor(countX * countY, [&](int start, int end, unsigned thread) {
+        for (int idx = start; idx < end; ++idx) {
+            int cx = colorX + 3 * (idx % countX);
+            int cy = colorY + 2 * (idx / countX);
+            fn(cx, cy, thread);
+        }
+    });
+}
+
+// Visit the candidate pairs owned by home cell (cx, cy): pairs inside it and pairs
+// with its half stencil. i always belongs to the home cell.
+template <typename Fn>
+void forEachPairOfCell(const CellGrid &grid, int cx, int cy, Fn &&fn) {
+    int home = cy * grid.nx + cx;
+    int homeStart = grid.cellStart[home], homeEnd = grid.cellStart[home + 1];
+    for (int a = homeStart; a < homeEnd; ++a) {
+        for (int b = a + 1; b < homeEnd; ++b) {
+            fn(grid.cellParticles[a], grid.cellParticles[b]);
+        }
+    }
+    for (const auto &offset : HALF_STENCIL) {
+        int other = grid.neighbor(cx, cy, offset[0], offset[1]);
+        if (other < 0) continue;
+        int otherStart = grid.cellStart[other], otherEnd = grid.cellStart[other + 1];
+        for (int a = homeStart; a < homeEnd; ++a) {
+            for (int b = otherStart; b < otherEnd; ++b) {
+                fn(grid.cellParticles[a], grid.cellParticles[b]);
+            }
+        }
+    }
+}
+
+// Visit each candidate pair (i, j) in the same or adjacent cells once, in parallel.
+// Because of the colouring fn may update both particles without locks or atomics.
+template <typename Fn>
+void forEachCellPair(const CellGrid &grid, ThreadPool &pool, Fn &&fn) {
+    for (int colorY = 0; colorY < 2; ++colorY) {
+        for (int colorX = 0; colorX < 3; ++colorX) {
+            forEachCellOfColor(grid, pool, colorX, colorY, [&](int cx, int cy, unsigned thread) {
+                forEachPairOfCell(grid, cx, cy, [&](int i, int j) { fn(i, j, thread); });
+            });
+        }
+    }
+}
+
+#endif // GRID_H
@@ -1,37 +1,51 @@
 #include <SFML/Graphics.hpp>
 #include <iostream>
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <unordered_map>
+#include <string>
 
 #include "particle.h"
+#include "cellkey.h"
+#include "ccd.h"
 #include "matrix.h"
+#include "threadpool.h"
+#include "flip.h"
+#include "md.h"
+#include "edmd.h"
+#include "xpbd.h"
+#include "dem.h"
+#include "dpd.h"
+#include "boids.h"
+#include "bonds.h"
+#include "shapematch.h"
+#include "polygon.h"
+#include "sdf.h"
+#include "container.h"
+#include "spheres.h"
+#include "render3d.h"
+#include "adaptive.h"
+#include "reactions.h"
+#include "thermal.h"
+#include "clusters.h"
+#include "diagnostics.h"
+#include "structure.h"
+#include "analysis.h"
+#include "trajectory.h"
+#include "rng.h"
+#include "thermostat.h"
+#include "grid.h"
 #include "cblas.h"
 #include "defs.h"
 
 #define X 0
 #define Y 1
 
-struct CellKey {
-    int x, y;
-    bool operator==(const CellKey &other) const { return x == other.x && y == other.y; }
-};
-
-namespace std {
-    template <>
-    struct hash<CellKey> {
-        std::size_t operator()(const CellKey &k) const {
-            return (std::hash<int>()(k.x) ^ (std::hash<int>()(k.y) << 1));
-        }
-    };
-}
-
-CellKey computeCellKey(float x, float y) {
-    return CellKey{static_cast<int>(x) / CELL_SIZE, static_cast<int>(y) / CELL_SIZE};
-}
-
 int main() {
     sf::RenderWindow window(sf::VideoMode({WINDOW_X, WINDOW_Y}), "Particle Simulation");
 
@@ -45,7 +59,7 @@ int main() {
     matrix accelerations(NUM_PARTICLES, DIMENSION);
 
     //Mapping of Keys to indices
-    std::unordered_map<CellKey, std::vector<int>> grid;
+    CellMap grid;
 
     //Vector of Mutexes for particles (safety for velocity updates)
     std::vector<std::mutex> particleMutexes(NUM_PARTICLES);
@@ -55,6 +69,7 @@ int main() {
     }
     // std::cout << "Number of threads: " << numThreads << std::endl;
     std::vector<std::thread> threads;
+    ThreadPool pool(numThreads);
 
     // Pre-allocate an array of Particle objects.
     Particle** particles = new Particle*[NUM_PARTICLES];
@@ -89,6 +104,194 @@ int main() {
         particles[i] = new Particle(pos_ptr, vel_ptr, acc_ptr, radius, color);
     }
 
+#if SIM_MODE == MODE_FLIP
+    FlipSolver flip(WINDOW_X, WINDOW_Y, FLIP_CELL_SIZE, pool);
+#elif SIM_MODE == MODE_MD
+    LennardJones md(WINDOW_X, WINDOW_Y, MD_SIGMA, MD_EPSILON, MD_MASS, MD_CUTOFF, MD_SKIN, pool);
+    md.initLattice(positions, velocities, MD_TEMPERATURE);
+    const double mdStep = MD_TIMESTEP * MD_SIGMA * std::sqrt(MD_MASS / MD_EPSILON);
+    Thermostat thermostat(static_cast<Thermostat::Kind>(THERMOSTAT), MD_TEMPERATURE, pool.size());
+#elif SIM_MODE == MODE_EDMD
+    HardSphereEDMD edmd(WINDOW_X, WINDOW_Y, RADIUS, EDMD_RESTITUTION, pool);
+    edmd.initGas(positions, velocities, EDMD_SPEED);
+#elif SIM_MODE == MODE_XPBD
+    XpbdSolver xpbd(WINDOW_X, WINDOW_Y, RADIUS, pool);
+#elif SIM_MODE == MODE_DEM
+    GranularDEM dem(WINDOW_X, WINDOW_Y, RADIUS, pool);
+#elif SIM_MODE == MODE_DPD
+    DissipativeParticles dpd(WINDOW_X, WINDOW_Y, DPD_CUTOFF, DPD_REPULSION, DPD_FRICTION, DPD_TEMPERATURE, pool);
+    dpd.initRandom(positions, velocities);
+    const double dpdStep = DPD_TIMESTEP * DPD_CUTOFF * std::sqrt(1.0 / DPD_TEMPERATURE);
+#elif SIM_MODE == MODE_BOIDS
+    // The agents live in the flock's SoA arrays and are drawn as points; the
+    // particle matrices are unused.
+    Flock flock(WINDOW_X, WINDOW_Y, BOIDS_RADIUS, pool);
+    flock.init(BOIDS_AGENTS, BOIDS_SEED);
+    sf::VertexArray agents(sf::PrimitiveType::Points, BOIDS_AGENTS);
+#elif SIM_MODE == MODE_3D
+    // 3D box of spheres drawn isometrically; the 2D particle matrices are unused.
+    matrix positions3(NUM_PARTICLES, 3);
+    matrix velocities3(NUM_PARTICLES, 3);
+    for (int i = 0; i < NUM_PARTICLES; ++i) {
+        positions3(i, X) = std::rand() % static_cast<int>(D3_BOX_X);
+        positions3(i, Y) = std::rand() % static_cast<int>(D3_BOX_Y / 2);
+        positions3(i, 2) = std::rand() % static_cast<int>(D3_BOX_Z);
+    }
+    ImpulseSpheres<3> spheres({D3_BOX_X, D3_BOX_Y, D3_BOX_Z}, D3_RADIUS, pool);
+    IsometricRenderer renderer(sf::Vector2f(WINDOW_X / 2.0f, D3_ORIGIN_Y), D3_SCALE, D3_RADIUS,
+                               D3_BOX_Y, D3_DEPTH_BUCKETS);
+#else
+    SweptCollision ccd(CCD_THRESHOLD, pool);
+    int reportedCcd = -1;
+
+    // Soft bodies: the first particles are laid out as square blocks and bonded.
+    BondNetwork bonds(pool);
+    const int bodySize = BOND_BODY_SIDE * BOND_BODY_SIDE;
+    for (int b = 0; b < BOND_BODIES && (b + 1) * bodySize <= NUM_PARTICLES; ++b) {
+        float left = (b + 1) * WINDOW_X / (BOND_BODIES + 1.0f) - 0.5f * BOND_BODY_SIDE * BOND_SPACING;
+        for (int k = 0; k < bodySize; ++k) {
+            int i = b * bodySize + k;
+            positions(i, X) = left + (k % BOND_BODY_SIDE) * BOND_SPACING;
+            positions(i, Y) = 50.0f + (k / BOND_BODY_SIDE) * BOND_SPACING;
+            velocities(i, X) = 0.0;
+            velocities(i, Y) = 0.0;
+        }
+        bonds.connect(positions, b * bodySize, bodySize, BOND_RANGE * BOND_SPACING);
+    }
+
+    // Rigid blocks from the particles after the soft bodies.
+    ShapeMatching shapes(pool);
+    const int clusterSize = SHAPE_CLUSTER_SIDE * SHAPE_CLUSTER_SIDE;
+    int nextParticle = std::min(BOND_BODIES, NUM_PARTICLES / bodySize) * bodySize;
+    for (int c = 0; c < SHAPE_CLUSTERS && nextParticle + clusterSize <= NUM_PARTICLES; ++c) {
+        float left = (c + 1) * WINDOW_X / (SHAPE_CLUSTERS + 1.0f);
+        std::vector<int> cluster;
+        for (int k = 0; k < clusterSize; ++k) {
+            int i = nextParticle++;
+            positions(i, X) = left + (k % SHAPE_CLUSTER_SIDE) * 2.0f * RADIUS;
+            positions(i, Y) = 150.0f + (k / SHAPE_CLUSTER_SIDE) * 2.0f * RADIUS;
+            velocities(i, X) = 0.0;
+            velocities(i, Y) = 0.0;
+            cluster.push_back(i);
+        }
+        shapes.addCluster(positions, cluster);
+    }
+#if POLYGON_DEMO
+    // A mixer paddle turning near the floor and a few loose bodies dropped in.
+    PolygonBodies polygons(WINDOW_X, WINDOW_Y);
+    int mixer = polygons.addBox(WINDOW_X / 2.0, WINDOW_Y - 120.0, 240.0, 16.0, POLYGON_DENSITY, true);
+    polygons.bodies[mixer].omega = POLYGON_MIXER_SPEED;
+    polygons.addBox(WINDOW_X / 4.0, 100.0, 60.0, 40.0, POLYGON_DENSITY, false);
+    polygons.addPolygon({ {0.0f, 0.0f}, {50.0f, 0.0f}, {25.0f, -45.0f} }, 3.0 * WINDOW_X / 4.0, 100.0,
+                        POLYGON_DENSITY, false);
+    polygons.addPolygon({ {0.0f, 0.0f}, {30.0f, -10.0f}, {40.0f, 20.0f}, {15.0f, 40.0f}, {-10.0f, 25.0f} },
+                        WINDOW_X / 2.0, 60.0, POLYGON_DENSITY, false);
+#endif
+
+#if SDF_DEMO
+    // Static container geometry: a funnel of two ramps and a peg.
+    ObstacleField obstacles(WINDOW_X, WINDOW_Y, SDF_SPACING);
+    obstacles.addBox(470.0f, 320.0f, 200.0f, 12.0f, 0.45f);
+    obstacles.addBox(730.0f, 320.0f, 200.0f, 12.0f, -0.45f);
+    obstacles.addCircle(450.0f, 520.0f, 30.0f);
+#endif
+
+    // Optional moving container; dragging with the right button turns it like
+    // the cube's rotation.
+    KinematicContainer container(static_cast<KinematicContainer::Shape>(CONTAINER_SHAPE),
+                                 WINDOW_X / 2.0f, WINDOW_Y / 2.0f, CONTAINER_HALF_WIDTH, CONTAINER_HALF_HEIGHT);
+
+    // Resting particles merge into heavier ones and split again when disturbed.
+    // The soft bodies and rigid blocks stay at full resolution.
+    AdaptiveResolution adaptive(WINDOW_X, WINDOW_Y, NUM_PARTICLES);
+    adaptive.pin(0, nextParticle);
+    int reportedActive = -1;
+
+#if REACTIONS
+    // The free particles start as fuel or oxidiser; the bodies and blocks stay inert.
+    ReactionSystem reactions(NUM_PARTICLES, pool);
+    int fuel = reactions.addSpecies(1.0f, RADIUS, sf::Color(255, 140, 0));
+    int oxidiser = reactions.addSpecies(1.0f, RADIUS, sf::Color(80, 160, 255));
+    int product = reactions.addSpecies(2.0f, RADIUS * std::sqrt(2.0f), sf::Color(160, 160, 160));
+    reactions.addContact(fuel, oxidiser, product, ReactionSystem::REMOVE, REACTION_PROBABILITY);
+    reactions.addDecay(fuel, oxidiser, REACTION_DECAY_RATE);
+    for (int i = nextParticle; i < NUM_PARTICLES; ++i) {
+        reactions.setSpecies(i, i % 2 == 0 ? fuel : oxidiser, particles);
+    }
+    // Merging assumes unit masses and radii, which reactions change.
+    adaptive.pin(0, NUM_PARTICLES);
+#endif
+
+    // Largest radius a particle can reach: merged particles have the area of the
+    // ones they merged, reaction products that of their species.
+    float maxRadius = RADIUS;
+#if ADAPTIVE
+    maxRadius = std::max(maxRadius, RADIUS * std::sqrt(static_cast<float>(ADAPTIVE_MAX_MERGE)));
+#endif
+#if REACTIONS
+    maxRadius = std::max(maxRadius, reactions.largestRadius());
+#endif
+#if SDF_DEMO
+    obstacles.flagCells(maxRadius);
+#endif
+
+#if THERMAL
+    // A furnace bed: heated along the floor, cooled along the top.
+    HeatConduction thermal(NUM_PARTICLES, pool);
+    thermal.addSource(0.0f, WINDOW_Y - THERMAL_SOURCE_DEPTH, WINDOW_X, WINDOW_Y, THERMAL_HOT, THERMAL_SOURCE_RATE);
+    thermal.addSource(0.0f, 0.0f, WINDOW_X, THERMAL_SOURCE_DEPTH, THERMAL_COLD, THERMAL_SOURCE_RATE);
+#endif
+
+#if CLUSTER_INTERVAL > 0
+    ContactClusters clusters(NUM_PARTICLES, pool);
+    int clusterFrame = 0;
+    std::vector<char> clusterActive(NUM_PARTICLES);
+    std::vector<float> clusterRadius(NUM_PARTICLES);
+#endif
+
+#if DIAGNOSTICS || STRUCTURE_INTERVAL > 0 || DENSITY_INTERVAL > 0
+    Diagnostics diagnostics(numThreads);
+#endif
+#if DIAGNOSTICS
+    diagnostics.open(DIAGNOSTICS_FILE, DIAGNOSTICS_BINARY ? Diagnostics::BINARY : Diagnostics::CSV);
+    long diagnosticStep = 0;
+#endif
+#if STRUCTURE_INTERVAL > 0 || DENSITY_INTERVAL > 0
+    diagnostics.openSeries(ANALYSIS_SERIES_FILE);
+#endif
+#if STRUCTURE_INTERVAL > 0 || DENSITY_INTERVAL > 0 || CHECKPOINT_INTERVAL > 0 || RECORD_INTERVAL > 0
+    // Analyses run a slice at a time within the frame budget.
+    AnalysisScheduler analysis(ANALYSIS_BUDGET_MS / 1000.0);
+    long analysisFrame = 0;
+#endif
+#if STRUCTURE_INTERVAL > 0
+    PairStructure structure(WINDOW_X, WINDOW_Y, STRUCTURE_RMAX, STRUCTURE_BINS, PERIODIC_X, PERIODIC_Y, pool);
+    std::vector<double> structureK(STRUCTURE_KBINS);
+    for (int q = 0; q < STRUCTURE_KBINS; ++q) structureK[q] = (q + 1) * STRUCTURE_KMAX / STRUCTURE_KBINS;
+    StructureJob structureJob(structure, diagnostics, structureK, STRUCTURE_WRITE_INTERVAL, STRUCTURE_SLICES);
+    analysis.add(structureJob, STRUCTURE_INTERVAL);
+#endif
+#if DENSITY_INTERVAL > 0
+    DensityFieldJob densityJob(WINDOW_X, WINDOW_Y, DENSITY_CELL, ANALYSIS_CHUNK, diagnostics);
+    analysis.add(densityJob, DENSITY_INTERVAL);
+#endif
+#if CHECKPOINT_INTERVAL > 0
+    CheckpointJob checkpointJob(CHECKPOINT_FILE, ANALYSIS_CHUNK);
+    analysis.add(checkpointJob, CHECKPOINT_INTERVAL);
+#endif
+#if RECORD_INTERVAL > 0
+    TrajectoryWriter recorder(RECORD_FILE, NUM_PARTICLES, WINDOW_X, WINDOW_Y, PERIODIC_X, PERIODIC_Y);
+    RecordJob recordJob(recorder, ANALYSIS_CHUNK);
+    analysis.add(recordJob, RECORD_INTERVAL);
+#endif
+    Thermostat thermostat(static_cast<Thermostat::Kind>(THERMOSTAT), THERMOSTAT_TEMPERATURE, pool.size());
+    float simTime = 0.0f;
+    sf::Vector2f prevMousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
+
+    CellGrid sortGrid(WINDOW_X, WINDOW_Y, CELL_SIZE, false);
+    int frame = 0;
+#endif
+
     sf::Clock clock;
     while (window.isOpen()) {
         while (std::optional event = window.pollEvent()) {
@@ -98,6 +301,53 @@ int main() {
 
         float dt = clock.restart().asSeconds();
 
+#if SIM_MODE == MODE_FLIP
+        flip.step(positions, velocities, dt, gravityY);
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_MD
+        // Fixed MD timestep, independent of the frame time.
+        for (int s = 0; s < MD_STEPS_PER_FRAME; ++s) {
+            md.step(positions, velocities, mdStep, THERMOSTAT == THERMOSTAT_NONE ? nullptr : &thermostat);
+        }
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_EDMD
+        edmd.advance(positions, velocities, dt);
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_XPBD
+        xpbd.step(positions, velocities, dt, gravityY);
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_DEM
+        dem.step(positions, velocities, dt, gravityY);
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_DPD
+        for (int s = 0; s < DPD_STEPS_PER_FRAME; ++s) {
+            dpd.step(positions, velocities, dpdStep);
+        }
+        for (int i = 0; i < NUM_PARTICLES; ++i) {
+            particles[i]->syncShape();
+        }
+#elif SIM_MODE == MODE_BOIDS
+        flock.step(std::min(dt, 1.0f / 30.0f));
+        for (int i = 0; i < flock.size(); ++i) {
+            // Colour by heading so the flocks stand out.
+            float speed = std::sqrt(flock.vx[i] * flock.vx[i] + flock.vy[i] * flock.vy[i]);
+            agents[i].position = sf::Vector2f(flock.x[i], flock.y[i]);
+            agents[i].color = sf::Color(static_cast<std::uint8_t>(128.0f + 127.0f * flock.vx[i] / speed),
+                                        static_cast<std::uint8_t>(128.0f + 127.0f * flock.vy[i] / speed), 255);
+        }
+#elif SIM_MODE == MODE_3D
+        spheres.step(positions3, velocities3, std::min(dt, 1.0f / 30.0f), gravityY);
+#else
         // Get the current mouse position relative to the window.
         sf::Vector2i mousePixelPos = sf::Mouse::getPosition(window);
         sf::Vector2f mousePos = window.mapPixelToCoords(mousePixelPos);
@@ -105,19 +355,135 @@ int main() {
         // Compute the cell key for the mouse position.
         CellKey mouseCell = computeCellKey(mousePos.x, mousePos.y);
 
+        if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Right)) {
+            container.angleOffset += (mousePos.x - prevMousePos.x) * 0.005f;
+        }
+        prevMousePos = mousePos;
+        simTime += dt;
+        container.update(simTime, dt, maxRadius);
+
+        // Particles about to move further than CCD_THRESHOLD relative to what they
+        // can hit take the swept path.
+        ccd.collectFast(positions, velocities, particles, grid, window.getSize(), dt);
+
+        int activeCount = adaptive.activeCount();
+#if REACTIONS
+        activeCount -= reactions.removedCount();
+#endif
+
+#if THERMOSTAT != THERMOSTAT_NONE
+        // Integrate and thermostat in the same pass over the particles.
+        thermostat.begin(dt);
+        pool.parallelFor(NUM_PARTICLES, [&](int start, int end, unsigned thread) {
+            double *x = positions.data.data();
+            double *v = velocities.data.data();
+            const double *a = accelerations.data.data();
+            double kinetic = thermostat.run(start, end, v,
+                [&](int i) {
+                    if (!particles[i]->active) return false;
+                    x[2 * i + X] += dt * v[2 * i + X];
+                    x[2 * i + Y] += dt * v[2 * i + Y];
+                    v[2 * i + X] += dt * a[2 * i + X];
+                    v[2 * i + Y] += dt * a[2 * i + Y];
+                    return true;
+                },
+                [&](int i) { return static_cast<double>(particles[i]->mass); });
+            thermostat.addKinetic(thread, kinetic);
+        });
+        thermostat.end(activeCount);
+#else
         // Update positions: positions = positions + velocities * dt
         cblas_daxpy(positions.data.size(), dt, velocities.data.data(), 1, positions.data.data(), 1);
         // Update velocities: velocities = velocities + accelerations * dt
         cblas_daxpy(positions.data.size(), dt, accelerations.data.data(), 1, velocities.data.data(), 1);
+#endif
+
+        // Sweep them against last frame's bins before the grid is rebuilt.
+        int ccdCount = ccd.resolve(positions, velocities, particles, grid, window.getSize());
+        if (ccdCount != reportedCcd || activeCount != reportedActive) {
+            window.setTitle("Particle Simulation - CCD particles: " + std::to_string(ccdCount) +
+                            " - active particles: " + std::to_string(activeCount));
+            reportedCcd = ccdCount;
+            reportedActive = activeCount;
+        }
+
+#if BOND_IMPLICIT
+        bonds.solveImplicit(positions, velocities, dt);
+#else
+        bonds.apply(positions, velocities, dt);
+#endif
+        shapes.apply(positions, velocities, dt);
+
+        // Keep particles that are close in space close in memory. The bins below
+        // are rebuilt from the new order, and the Particle objects keep pointing at
+        // the same rows.
+        if (BOND_SORT_INTERVAL > 0 && ++frame % BOND_SORT_INTERVAL == 0) {
+            sortGrid.build(positions);
+            const std::vector<int> &order = sortGrid.cellParticles;
+            positions.permuteRows(order);
+            velocities.permuteRows(order);
+            accelerations.permuteRows(order);
+            bonds.permute(order);
+            shapes.permute(order);
+            adaptive.permute(order, particles);
+#if REACTIONS
+            reactions.permute(order, particles);
+#endif
+#if THERMAL
+            thermal.permute(order);
+#endif
+#if CLUSTER_INTERVAL > 0
+            clusters.permute(order);
+#endif
+#if RECORD_INTERVAL > 0
+            recorder.permute(order);
+#endif
+        }
+
+#if ADAPTIVE
+        if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
+            adaptive.disturb(mousePos.x, mousePos.y, interactionRadius + CELL_SIZE);
+        }
+        adaptive.update(positions, velocities, accelerations, particles, gravityY);
+#endif
 
         grid.clear();
         for (int i = 0; i < NUM_PARTICLES; ++i) {
-            particles[i]->handleBoundaryCollision(window.getSize());
-            particles[i]->syncShape();
+            if (!particles[i]->active) continue;
+#if DIAGNOSTICS
+            double wallVX = particles[i]->vel[X], wallVY = particles[i]->vel[Y];
+#endif
+            [[maybe_unused]] int walls = particles[i]->handleBoundaryCollision<PERIODIC_X, PERIODIC_Y>(window.getSize());
+#if DIAGNOSTICS
+            // The walls' impulse is the velocity change of the walls that were hit.
+            double mass = particles[i]->mass;
+            if (walls & (Particle::LEFT_WALL | Particle::RIGHT_WALL)) {
+                diagnostics.addWallImpulse(0, walls & Particle::LEFT_WALL ? Diagnostics::LEFT : Diagnostics::RIGHT,
+                                           mass * std::abs(particles[i]->vel[X] - wallVX));
+            }
+            if (walls & (Particle::TOP_WALL | Particle::BOTTOM_WALL)) {
+                diagnostics.addWallImpulse(0, walls & Particle::TOP_WALL ? Diagnostics::TOP : Diagnostics::BOTTOM,
+                                           mass * std::abs(particles[i]->vel[Y] - wallVY));
+            }
+#endif
             float x = static_cast<float>(particles[i]->pos[X]);
             float y = static_cast<float>(particles[i]->pos[Y]);
             CellKey key = computeCellKey(x, y);
+#if SDF_DEMO
+            // Only particles in cells flagged near an obstacle sample the field.
+            if (obstacles.isNear(key) && obstacles.collide(particles[i]->pos, particles[i]->vel, particles[i]->radius)) {
+                key = computeCellKey(static_cast<float>(particles[i]->pos[X]), static_cast<float>(particles[i]->pos[Y]));
+            }
+#endif
+            if (container.isNear(key) && container.collide(particles[i]->pos, particles[i]->vel, particles[i]->radius)) {
+                key = computeCellKey(static_cast<float>(particles[i]->pos[X]), static_cast<float>(particles[i]->pos[Y]));
+            }
+            particles[i]->syncShape();
             grid[key].push_back(i);
+#if DIAGNOSTICS
+            diagnostics.addParticle(0, mass, particles[i]->pos[Y], particles[i]->vel[X], particles[i]->vel[Y],
+                                    window.getSize().y, gravityY);
+#endif
         }
 
         std::vector<CellKey> CellKeys;
@@ -129,7 +495,21 @@ int main() {
         int extraCells = totalCells % numThreads;
         int currentIndex = 0;
 
-        auto processCells = [&](int start, int end) {
+#if THERMAL
+        thermal.begin(dt);
+#endif
+#if CLUSTER_INTERVAL > 0
+        // Label the clusters from this frame's contacts every CLUSTER_INTERVAL frames.
+        bool clustering = ++clusterFrame % CLUSTER_INTERVAL == 0;
+        if (clustering) {
+            for (int i = 0; i < NUM_PARTICLES; ++i) {
+                clusterActive[i] = particles[i]->active;
+                clusterRadius[i] = particles[i]->radius;
+            }
+            clusters.begin(positions, clusterActive.data(), clusterRadius.data());
+        }
+#endif
+        auto processCells = [&](int start, int end, [[maybe_unused]] unsigned thread) {
             for (int idx = start; idx < end; ++idx) {
                 CellKey key = CellKeys[idx];
                 const auto &cellParticles = grid[key];
@@ -146,13 +526,14 @@ int main() {
                         float y2 = static_cast<float>(particles[j]->pos[Y]);
                         float dx = x2 - x1;
                         float dy = y2 - y1;
+                        minimumImage<PERIODIC_X, PERIODIC_Y>(dx, dy);
                         float dist2 = dx * dx + dy * dy;
                         float radiusSum = particles[i]->radius + particles[j]->radius;
                         
                         if (dist2 < radiusSum * radiusSum) {
                             float distance = std::sqrt(dist2);
                             if (distance == 0.f) {
-                                distance = 0.1f;
+                                distance = radiusSum;  // coincident: separate along x with a unit normal
                                 dx = radiusSum;
                                 dy = 0.f;
                             }
@@ -166,13 +547,29 @@ int main() {
                             
                             float relVel = (v1x - v2x) * nx + (v1y - v2y) * ny;
                             float impulse = relVel;
+                            // Equal masses swap normal velocities; merged particles are heavier.
+                            float massSum = particles[i]->mass + particles[j]->mass;
+                            float shareI = 2.0f * particles[j]->mass / massSum;
+                            float shareJ = 2.0f * particles[i]->mass / massSum;
                             
                             // Lock both particles to update velocities safely.
                             std::scoped_lock lock(particleMutexes[i], particleMutexes[j]);
-                            particles[i]->vel[X] = v1x - impulse * nx * (1 - ENTROPY);
-                            particles[i]->vel[Y] = v1y - impulse * ny * (1 - ENTROPY);
-                            particles[j]->vel[X] = v2x + impulse * nx * (1 - ENTROPY);
-                            particles[j]->vel[Y] = v2y + impulse * ny * (1 - ENTROPY);
+                            particles[i]->vel[X] = v1x - impulse * nx * (1 - ENTROPY) * shareI;
+                            particles[i]->vel[Y] = v1y - impulse * ny * (1 - ENTROPY) * shareI;
+                            particles[j]->vel[X] = v2x + impulse * nx * (1 - ENTROPY) * shareJ;
+                            particles[j]->vel[Y] = v2y + impulse * ny * (1 - ENTROPY) * shareJ;
+#if THERMAL
+                            thermal.exchange(thread, i, j, radiusSum - distance);
+#endif
+#if CLUSTER_INTERVAL > 0
+                            if (clustering) clusters.unite(thread, i, j);
+#endif
+#if DIAGNOSTICS
+                            diagnostics.addContact(thread, radiusSum - distance);
+#endif
+#if REACTIONS
+                            reactions.contact(thread, i, j);
+#endif
                         }
                     }
                 }
@@ -181,7 +578,7 @@ int main() {
                 for (int dx = -1; dx <= 1; ++dx) {
                     for (int dy = -1; dy <= 1; ++dy) {
                         if (dx == 0 && dy == 0) continue;
-                        CellKey neighborKey{ key.x + dx, key.y + dy };
+                        CellKey neighborKey = neighborCellKey<PERIODIC_X, PERIODIC_Y>(key, dx, dy);
                         if (grid.count(neighborKey)) {
                             const auto &neighborParticles = grid[neighborKey];
                             for (int i : cellParticles) {
@@ -193,13 +590,14 @@ int main() {
                                         float y2 = static_cast<float>(particles[j]->pos[Y]);
                                         float dx = x2 - x1;
                                         float dy = y2 - y1;
+                                        minimumImage<PERIODIC_X, PERIODIC_Y>(dx, dy);
                                         float dist2 = dx * dx + dy * dy;
                                         float radiusSum = particles[i]->radius + particles[j]->radius;
                                         
                                         if (dist2 < radiusSum * radiusSum) {
                                             float distance = std::sqrt(dist2);
                                             if (distance == 0.f) {
-                                                distance = 0.1f;
+                                                distance = radiusSum;  // coincident: separate along x with a unit normal
                                                 dx = radiusSum;
                                                 dy = 0.f;
                                             }
@@ -213,12 +611,28 @@ int main() {
                                             
                                             float relVel = (v1x - v2x) * nx + (v1y - v2y) * ny;
                                             float impulse = relVel;
+                                            // Equal masses swap normal velocities; merged particles are heavier.
+                                            float massSum = particles[i]->mass + particles[j]->mass;
+                                            float shareI = 2.0f * particles[j]->mass / massSum;
+                                            float shareJ = 2.0f * particles[i]->mass / massSum;
                                             
                                             std::scoped_lock lock(particleMutexes[i], particleMutexes[j]);
-                                            particles[i]->vel[X] = v1x - impulse * nx * (1 - ENTROPY);
-                                            particles[i]->vel[Y] = v1y - impulse * ny * (1 - ENTROPY);
-                                            particles[j]->vel[X] = v2x + impulse * nx * (1 - ENTROPY);
-                                            particles[j]->vel[Y] = v2y + impulse * ny * (1 - ENTROPY);
+                                            particles[i]->vel[X] = v1x - impulse * nx * (1 - ENTROPY) * shareI;
+                                            particles[i]->vel[Y] = v1y - impulse * ny * (1 - ENTROPY) * shareI;
+                                            particles[j]->vel[X] = v2x + impulse * nx * (1 - ENTROPY) * shareJ;
+                                            particles[j]->vel[Y] = v2y + impulse * ny * (1 - ENTROPY) * shareJ;
+#if THERMAL
+                                            thermal.exchange(thread, i, j, radiusSum - distance);
+#endif
+#if CLUSTER_INTERVAL > 0
+                                            if (clustering) clusters.unite(thread, i, j);
+#endif
+#if DIAGNOSTICS
+                                            diagnostics.addContact(thread, radiusSum - distance);
+#endif
+#if REACTIONS
+                                            reactions.contact(thread, i, j);
+#endif
                                         }
                                     }
                                 }
@@ -231,9 +645,9 @@ int main() {
 
         for (unsigned int t = 0; t < numThreads; t++) {
             int start = currentIndex;
-            int count = cellsPerThread + (t < extraCells ? 1 : 0);
+            int count = cellsPerThread + (static_cast<int>(t) < extraCells ? 1 : 0);
             int end = start + count;
-            threads.emplace_back(processCells, start, end);
+            threads.emplace_back(processCells, start, end, t);
             currentIndex = end;
         }
 
@@ -242,6 +656,41 @@ int main() {
         }
         threads.clear();
 
+#if REACTIONS
+        // Apply the reactions the contacts above recorded, all at once.
+        reactions.commit(positions, velocities, accelerations, particles, dt);
+#endif
+#if THERMAL
+        thermal.apply(positions, accelerations, particles, gravityY);
+#endif
+#if CLUSTER_INTERVAL > 0
+        if (clustering) {
+            for (int i = 0; i < NUM_PARTICLES; ++i) clusterActive[i] = particles[i]->active;
+            clusters.finish(positions, clusterActive.data());
+#if CLUSTER_COLORS
+            // Paint each large cluster its own colour until the next round.
+            for (int i = 0; i < NUM_PARTICLES; ++i) {
+                int c = clusters.labels()[i];
+                if (clusters.sizeOf(c) < CLUSTER_MIN_SIZE) continue;
+                std::uint64_t bits = mix64(static_cast<std::uint64_t>(c));
+                particles[i]->shape.setFillColor(sf::Color(80 + bits % 176, 80 + (bits >> 8) % 176, 80 + (bits >> 16) % 176));
+            }
+#endif
+        }
+#endif
+#if DIAGNOSTICS
+        diagnostics.end(diagnosticStep++, simTime, dt, window.getSize().x, window.getSize().y);
+#endif
+#if STRUCTURE_INTERVAL > 0 || DENSITY_INTERVAL > 0 || CHECKPOINT_INTERVAL > 0 || RECORD_INTERVAL > 0
+        analysis.frame(analysisFrame++, simTime, positions, velocities, particles);
+#endif
+
+#if POLYGON_DEMO
+        // Two-way contacts with the rigid polygons, using the bins just built.
+        polygons.collide(positions, velocities, grid, particles);
+        polygons.step(dt, gravityY);
+#endif
+
         if(sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)){
             // Determine how many cells to check in each direction.
             // This ensures we cover an area at least as large as the interaction radius.
@@ -279,12 +728,28 @@ int main() {
                 }
             }
         }   
+#endif
 
         // Drawing.
         window.clear();
+#if SIM_MODE == MODE_3D
+        renderer.draw(window, positions3);
+#elif SIM_MODE == MODE_BOIDS
+        window.draw(agents);
+#else
         for (int i = 0; i < NUM_PARTICLES; ++i) {
-            particles[i]->draw(window);
+            if (particles[i]->active) particles[i]->draw(window);
         }
+#endif
+#if SIM_MODE == MODE_COLLISION
+#if SDF_DEMO
+        obstacles.draw(window);
+#endif
+#if POLYGON_DEMO
+        polygons.draw(window);
+#endif
+        container.draw(window);
+#endif
         window.display();
     }
 
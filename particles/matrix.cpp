@@ -138,6 +138,19 @@ void matrix::copy(const matrix& src) {
     std::copy(src.data.begin(), src.data.end(), data.begin());
 }
 
+void matrix::permuteRows(const std::vector<int>& order) {
+    if (order.size() != static_cast<size_t>(rows)) {
+        throw std::invalid_argument("Permutation size mismatch for row reorder");
+    }
+    std::vector<double> result(data.size());
+    for (int k = 0; k < rows; ++k) {
+        std::copy(data.begin() + order[k] * cols, data.begin() + (order[k] + 1) * cols,
+                  result.begin() + k * cols);
+    }
+    // Copy back rather than swap so pointers into the rows stay valid.
+    std::copy(result.begin(), result.end(), data.begin());
+}
+
 void matrix::serializeMatrix(std::ostream &out) const {
     out << this->rows << " " << this->cols << "\n";
     for (int i = 0; i < this->rows; ++i) {
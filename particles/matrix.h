@@ -1,6 +1,7 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <iosfwd>
 #include <vector>
 
 class matrix {
@@ -35,6 +36,10 @@ public:
 
     void copy(const matrix& src);
 
+    // Reorder rows so that row k becomes the old row order[k]. Done in place, so
+    // pointers into data stay valid.
+    void permuteRows(const std::vector<int>& order);
+
     void serializeMatrix(std::ostream &out) const;
 
     void deserializeMatrix(std::istream &in);
@@ -0,0 +1,222 @@
+#include "md.h"
+#include "cblas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#define X 0
+#define Y 1
+
+LennardJones::LennardJones(float boxX, float boxY, double sigma, double epsilon, double mass,
+                           double cutoff, double skin, ThreadPool &pool)
+    : sigma(sigma), epsilon(epsilon), mass(mass),
+      grid(boxX, boxY, static_cast<float>((cutoff + skin) * sigma), true), pool(pool)
+{
+    double rc = cutoff * sigma;
+    cutoff2 = rc * rc;
+    this->skin = skin * sigma;
+    listRadius2 = (rc + this->skin) * (rc + this->skin);
+
+    double sr6 = std::pow(sigma / rc, 6);
+    energyShift = 4.0 * epsilon * (sr6 * sr6 - sr6);
+
+    capacity = 32;
+    threadPotential.assign(pool.size(), 0.0);
+}
+
+void LennardJones::initLattice(matrix &positions, matrix &velocities, double temperature) const {
+    int n = positions.rows;
+    int cols = static_cast<int>(std::ceil(std::sqrt(n * static_cast<double>(grid.width) / grid.height)));
+    int rows = (n + cols - 1) / cols;
+    double ax = grid.width / cols;
+    double ay = grid.height / rows;
+
+    std::mt19937 gen(12345);
+    std::normal_distribution<double> dist(0.0, std::sqrt(temperature / mass));
+    double px = 0.0, py = 0.0;
+    for (int i = 0; i < n; ++i) {
+        positions(i, X) = (i % cols + 0.5) * ax;
+        positions(i, Y) = (i / cols + 0.5) * ay;
+        velocities(i, X) = dist(gen);
+        velocities(i, Y) = dist(gen);
+        px += velocities(i, X);
+        py += velocities(i, Y);
+    }
+
+    // Remove the centre-of-mass drift, then rescale to the exact temperature
+    // (two degrees of freedom per particle, k_B = 1).
+    double ke = 0.0;
+    for (int i = 0; i < n; ++i) {
+        velocities(i, X) -= px / n;
+        velocities(i, Y) -= py / n;
+        ke += 0.5 * mass * (velocities(i, X) * velocities(i, X) + velocities(i, Y) * velocities(i, Y));
+    }
+    if (ke > 0.0) {
+        cblas_dscal(n * 2, std::sqrt(n * temperature / ke), velocities.data.data(), 1);
+    }
+}
+
+double LennardJones::kineticEnergy(const matrix &velocities) const {
+    int n = static_cast<int>(velocities.data.size());
+    return 0.5 * mass * cblas_ddot(n, velocities.data.data(), 1, velocities.data.data(), 1);
+}
+
+void LennardJones::buildNeighborList(const matrix &positions) {
+    int n = positions.rows;
+    grid.build(positions);
+
+    while (true) {
+        neighborCount.assign(n, 0);
+        neighbors.resize(static_cast<size_t>(n) * capacity);
+
+        forEachCellPair(grid, pool, [&](int i, int j, unsigned) {
+            double dx = positions(j, X) - positions(i, X);
+            double dy = positions(j, Y) - positions(i, Y);
+            grid.minimumImage(dx, dy);
+            if (dx * dx + dy * dy < listRadius2) {
+                int k = neighborCount[i]++;
+                if (k < capacity) neighbors[static_cast<size_t>(i) * capacity + k] = j;
+            }
+        });
+
+        int most = n > 0 ? *std::max_element(neighborCount.begin(), neighborCount.end()) : 0;
+        if (most <= capacity) break;
+        capacity = most + most / 4 + 1;
+    }
+
+    buildPositions = positions.data;
+    rebuilds++;
+}
+
+bool LennardJones::needsRebuild(const matrix &positions) {
+    std::vector<double> threadMax(pool.size(), 0.0);
+    pool.parallelFor(positions.rows, [&](int start, int end, unsigned thread) {
+        double most = 0.0;
+        for (int i = start; i < end; ++i) {
+            double dx = positions(i, X) - buildPositions[2 * i];
+            double dy = positions(i, Y) - buildPositions[2 * i + 1];
+            grid.minimumImage(dx, dy);
+            most = std::max(most, dx * dx + dy * dy);
+        }
+        threadMax[thread] = most;
+    });
+    double limit = 0.5 * skin;
+    return *std::max_element(threadMax.begin(), threadMax.end()) > limit * limit;
+}
+
+void LennardJones::computeForces(const matrix &positions) {
+    forces.assign(positions.data.size(), 0.0);
+    std::fill(threadPotential.begin(), threadPotential.end(), 0.0);
+    scratch.resize(pool.size());
+    for (auto &buffer : scratch) buffer.resize(3 * capacity);
+
+    const double *pos = positions.data.data();
+    const double boxX = grid.width, boxY = grid.height;
+    const double halfX = 0.5 * boxX, halfY = 0.5 * boxY;
+    const double sigma2 = sigma * sigma;
+    const double rc2 = cutoff2;
+    const double eps = epsilon, shift = energyShift;
+
+    // Same colouring as the list build: every j in row i lives in the home cell
+    // or its forward stencil, so both ends of a pair are updated without atomics.
+    for (int colorY = 0; colorY < 2; ++colorY) {
+        for (int colorX = 0; colorX < 3; ++colorX) {
+            forEachCellOfColor(grid, pool, colorX, colorY, [&](int cx, int cy, unsigned thread) {
+                double *fxs = scratch[thread].data();
+                double *fys = fxs + capacity;
+                double *energies = fys + capacity;
+                double energy = 0.0;
+
+                int home = cy * grid.nx + cx;
+                for (int a = grid.cellStart[home]; a < grid.cellStart[home + 1]; ++a) {
+                    int i = grid.cellParticles[a];
+                    int count = neighborCount[i];
+                    const int *row = &neighbors[static_cast<size_t>(i) * capacity];
+                    double xi = pos[2 * i], yi = pos[2 * i + 1];
+
+                    // Branch-free so the compiler can vectorise across the row.
+                    for (int k = 0; k < count; ++k) {
+                        int j = row[k];
+                        double dx = xi - pos[2 * j];
+                        double dy = yi - pos[2 * j + 1];
+                        dx = dx > halfX ? dx - boxX : (dx < -halfX ? dx + boxX : dx);
+                        dy = dy > halfY ? dy - boxY : (dy < -halfY ? dy + boxY : dy);
+                        double r2 = dx * dx + dy * dy;
+                        double inside = r2 < rc2 ? 1.0 : 0.0;
+                        double inv2 = sigma2 / r2;
+                        double inv6 = inv2 * inv2 * inv2;
+                        double fscale = inside * 24.0 * eps * inv6 * (2.0 * inv6 - 1.0) / r2;
+                        fxs[k] = fscale * dx;
+                        fys[k] = fscale * dy;
+                        energies[k] = inside * (4.0 * eps * inv6 * (inv6 - 1.0) - shift);
+                    }
+
+                    double fxi = 0.0, fyi = 0.0;
+                    for (int k = 0; k < count; ++k) {
+                        int j = row[k];
+                        fxi += fxs[k];
+                        fyi += fys[k];
+                        forces[2 * j] -= fxs[k];
+                        forces[2 * j + 1] -= fys[k];
+                        energy += energies[k];
+                    }
+                    forces[2 * i] += fxi;
+                    forces[2 * i + 1] += fyi;
+                }
+                threadPotential[thread] += energy;
+            });
+        }
+    }
+
+    potential = 0.0;
+    for (double e : threadPotential) potential += e;
+}
+
+void LennardJones::step(matrix &positions, matrix &velocities, double dt, Thermostat *thermostat) {
+    if (!forcesValid) {
+        buildNeighborList(positions);
+        computeForces(positions);
+        forcesValid = true;
+    }
+
+    double halfKick = 0.5 * dt / mass;
+    pool.parallelFor(positions.rows, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            velocities(i, X) += halfKick * forces[2 * i];
+            velocities(i, Y) += halfKick * forces[2 * i + 1];
+            positions(i, X) += dt * velocities(i, X);
+            positions(i, Y) += dt * velocities(i, Y);
+            grid.wrap(positions(i, X), positions(i, Y));
+        }
+    });
+
+    if (needsRebuild(positions)) {
+        buildNeighborList(positions);
+    }
+    computeForces(positions);
+
+    if (!thermostat) {
+        pool.parallelFor(positions.rows, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                velocities(i, X) += halfKick * forces[2 * i];
+                velocities(i, Y) += halfKick * forces[2 * i + 1];
+            }
+        });
+        return;
+    }
+
+    // The thermostat rides on the closing kick, so it costs no extra pass.
+    thermostat->begin(dt);
+    pool.parallelFor(positions.rows, [&](int start, int end, unsigned thread) {
+        double kinetic = thermostat->run(start, end, velocities.data.data(),
+            [&](int i) {
+                velocities(i, X) += halfKick * forces[2 * i];
+                velocities(i, Y) += halfKick * forces[2 * i + 1];
+                return true;
+            },
+            [&](int) { return mass; });
+        thermostat->addKinetic(thread, kinetic);
+    });
+    thermostat->end(positions.rows);
+}
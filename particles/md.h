@@ -0,0 +1,56 @@
+#ifndef MD_H
+#define MD_H
+
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "thermostat.h"
+
+// Lennard-Jones molecular dynamics in a periodic box: truncated and shifted pair
+// potential, velocity-Verlet integration and half (Newton's third law) Verlet
+// neighbour lists built from a cell grid sized to cutoff + skin. Units are
+// whatever sigma, epsilon and mass are given in; the benchmark uses reduced units.
+class LennardJones {
+public:
+    LennardJones(float boxX, float boxY, double sigma, double epsilon, double mass,
+                 double cutoff, double skin, ThreadPool &pool);
+
+    // Place particles on a square lattice filling the box and draw velocities for
+    // the given temperature with zero total momentum.
+    void initLattice(matrix &positions, matrix &velocities, double temperature) const;
+
+    // One velocity-Verlet step, optionally thermostatted in its closing kick.
+    void step(matrix &positions, matrix &velocities, double dt, Thermostat *thermostat = nullptr);
+
+    double potentialEnergy() const { return potential; }
+    double kineticEnergy(const matrix &velocities) const;
+    int neighborRebuilds() const { return rebuilds; }
+
+private:
+    void buildNeighborList(const matrix &positions);
+    bool needsRebuild(const matrix &positions);
+    void computeForces(const matrix &positions);
+
+    double sigma, epsilon, mass;
+    double cutoff2, listRadius2, skin;
+    double energyShift;
+    CellGrid grid;
+    ThreadPool &pool;
+
+    // Fixed-capacity neighbour rows; row i holds partners of i within cutoff + skin.
+    // Each pair is stored once, in the row of the particle in the home cell.
+    int capacity;
+    std::vector<int> neighborCount;
+    std::vector<int> neighbors;
+    std::vector<double> buildPositions;
+
+    std::vector<double> forces;
+    std::vector<double> threadPotential;
+    std::vector<std::vector<double>> scratch;
+    double potential = 0.0;
+    bool forcesValid = false;
+    int rebuilds = 0;
+};
+
+#endif // MD_H
@@ -18,24 +18,10 @@ void Particle::syncShape() {
     shape.setPosition(sf::Vector2f(static_cast<float>(pos[0]), static_cast<float>(pos[1])));
 }
 
-void Particle::handleBoundaryCollision(const sf::Vector2u& windowSize) {
-    // Retrieve current position and velocity.
-    float x = static_cast<float>(pos[0]);
-    float y = static_cast<float>(pos[1]);
-
-    float vx = static_cast<float>(vel[0]);
-    float vy = static_cast<float>(vel[1]);
-
-    // Bounce off left/right boundaries.
-    if (x - radius < 0 || x + radius > windowSize.x)
-        vx = -vx;
-    // Bounce off top/bottom boundaries.
-    if (y - radius < 0 || y + radius > windowSize.y)
-        vy = -vy * (1 - ENTROPY);
-
-    // Update the velocity values.
-    vel[0] = vx;
-    vel[1] = vy;
+void Particle::setRadius(float r) {
+    radius = r;
+    shape.setRadius(r);
+    shape.setOrigin(sf::Vector2f(r, r));
 }
 
 void Particle::draw(sf::RenderWindow &window) {
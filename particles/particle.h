@@ -2,6 +2,7 @@
 #define PARTICLE_H
 
 #include <SFML/Graphics.hpp>
+#include <cmath>
 #include "defs.h"
 
 
@@ -15,6 +16,10 @@ public:
 
     // Particle properties.
     float radius;
+    // Mass in units of a base particle; above 1 for merged particles.
+    float mass = 1.0f;
+    // Inactive particles have been merged into another and are skipped.
+    bool active = true;
     sf::Color color;
     sf::CircleShape shape;
 
@@ -24,11 +29,55 @@ public:
     // Sync the drawable shape's position with the particle's state.
     void syncShape();
 
-    // Handle collisions with the window boundaries.
-    void handleBoundaryCollision(const sf::Vector2u& windowSize);
+    // Change the radius and the drawable shape with it.
+    void setRadius(float r);
+
+    // Walls of the window, as bits of the mask handleBoundaryCollision returns.
+    enum Wall { LEFT_WALL = 1, RIGHT_WALL = 2, TOP_WALL = 4, BOTTOM_WALL = 8 };
+
+    // Handle collisions with the window boundaries and return the walls that
+    // reflected the particle. Periodic axes wrap instead of reflecting; the choice
+    // is made at compile time so walls pay nothing for it.
+    template <bool PeriodicX = false, bool PeriodicY = false>
+    int handleBoundaryCollision(const sf::Vector2u& windowSize);
 
     // Draw the particle.
     void draw(sf::RenderWindow &window);
 };
 
+template <bool PeriodicX, bool PeriodicY>
+int Particle::handleBoundaryCollision(const sf::Vector2u& windowSize) {
+    // Retrieve current position.
+    float x = static_cast<float>(pos[0]);
+    float y = static_cast<float>(pos[1]);
+    int walls = 0;
+
+    if constexpr (PeriodicX) {
+        // Wrap into [0, width).
+        if (x < 0 || x >= windowSize.x)
+            pos[0] -= windowSize.x * std::floor(pos[0] / windowSize.x);
+    } else {
+        // Bounce off left/right boundaries.
+        if (x - radius < 0)
+            walls |= LEFT_WALL;
+        else if (x + radius > windowSize.x)
+            walls |= RIGHT_WALL;
+        if (walls)
+            vel[0] = -vel[0];
+    }
+    if constexpr (PeriodicY) {
+        if (y < 0 || y >= windowSize.y)
+            pos[1] -= windowSize.y * std::floor(pos[1] / windowSize.y);
+    } else {
+        // Bounce off top/bottom boundaries.
+        if (y - radius < 0)
+            walls |= TOP_WALL;
+        else if (y + radius > windowSize.y)
+            walls |= BOTTOM_WALL;
+        if (walls & (TOP_WALL | BOTTOM_WALL))
+            vel[1] = -vel[1] * (1 - ENTROPY);
+    }
+    return walls;
+}
+
 #endif // PARTICLE_H
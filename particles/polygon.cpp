@@ -0,0 +1,214 @@
+#include "polygon.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+// 2D counterpart of the cube's rotateVector.
+static sf::Vector2f rotateVector(const sf::Vector2f &v, float angle) {
+    float cosA = std::cos(angle);
+    float sinA = std::sin(angle);
+    return sf::Vector2f(v.x * cosA - v.y * sinA, v.x * sinA + v.y * cosA);
+}
+
+// Recalculate the drawable shape from the body's rotated vertices.
+static void calcShape(sf::ConvexShape &shape, const std::vector<sf::Vector2f> &local,
+                      const sf::Vector2f &position, float angle) {
+    shape.setPointCount(local.size());
+    for (size_t k = 0; k < local.size(); ++k) {
+        shape.setPoint(k, position + rotateVector(local[k], angle));
+    }
+}
+
+static double cross(double ax, double ay, double bx, double by) {
+    return ax * by - ay * bx;
+}
+
+PolygonBodies::PolygonBodies(float width, float height) : width(width), height(height) {}
+
+int PolygonBodies::addPolygon(const std::vector<sf::Vector2f> &vertices, double x, double y,
+                              double density, bool kinematic) {
+    RigidPolygon body;
+    body.local = vertices;
+    int count = static_cast<int>(vertices.size());
+
+    // Area and centroid from a triangle fan; flip to positive orientation so edge
+    // normals (ey, -ex) point outwards.
+    double area = 0.0, cx = 0.0, cy = 0.0;
+    for (int k = 0; k < count; ++k) {
+        const sf::Vector2f &a = vertices[k], &b = vertices[(k + 1) % count];
+        double c = cross(a.x, a.y, b.x, b.y);
+        area += 0.5 * c;
+        cx += (a.x + b.x) * c;
+        cy += (a.y + b.y) * c;
+    }
+    cx /= 6.0 * area;
+    cy /= 6.0 * area;
+    if (area < 0.0) {
+        std::reverse(body.local.begin(), body.local.end());
+        area = -area;
+    }
+    for (auto &v : body.local) {
+        v.x -= static_cast<float>(cx);
+        v.y -= static_cast<float>(cy);
+    }
+
+    double second = 0.0;
+    for (int k = 0; k < count; ++k) {
+        const sf::Vector2f &a = body.local[k], &b = body.local[(k + 1) % count];
+        second += cross(a.x, a.y, b.x, b.y) * (a.x * a.x + a.y * a.y + a.x * b.x + a.y * b.y + b.x * b.x + b.y * b.y);
+    }
+
+    body.x = x + cx;
+    body.y = y + cy;
+    body.angle = 0.0;
+    body.vx = body.vy = body.omega = 0.0;
+    body.mass = density * area;
+    body.inertia = density * second / 12.0;
+    body.kinematic = kinematic;
+    body.shape.setFillColor(kinematic ? sf::Color(200, 80, 80) : sf::Color(80, 140, 220));
+    calcShape(body.shape, body.local, sf::Vector2f(body.x, body.y), 0.0f);
+    bodies.push_back(body);
+    return static_cast<int>(bodies.size()) - 1;
+}
+
+int PolygonBodies::addBox(double x, double y, double w, double h, double density, bool kinematic) {
+    float hw = static_cast<float>(0.5 * w), hh = static_cast<float>(0.5 * h);
+    return addPolygon({ {-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh} }, x, y, density, kinematic);
+}
+
+int PolygonBodies::collide(matrix &positions, matrix &velocities, const CellMap &grid, Particle **particles) {
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+    int contacts = 0;
+
+    // The broadphase pads the bounding boxes by the largest particle.
+    float radius = 0.0f;
+    for (int i = 0; i < positions.rows; ++i) radius = std::max(radius, particles[i]->radius);
+
+    for (auto &body : bodies) {
+        int count = static_cast<int>(body.local.size());
+        std::vector<sf::Vector2f> world(count);
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+        for (int k = 0; k < count; ++k) {
+            world[k] = sf::Vector2f(body.x, body.y) + rotateVector(body.local[k], body.angle);
+            minX = std::min(minX, world[k].x);
+            minY = std::min(minY, world[k].y);
+            maxX = std::max(maxX, world[k].x);
+            maxY = std::max(maxY, world[k].y);
+        }
+
+        // Broadphase: the particle cells overlapping the bounding box.
+        candidates.clear();
+        CellKey lo = computeCellKey(std::max(0.0f, minX - radius), std::max(0.0f, minY - radius));
+        CellKey hi = computeCellKey(maxX + radius, maxY + radius);
+        for (int cx = lo.x; cx <= hi.x; ++cx) {
+            for (int cy = lo.y; cy <= hi.y; ++cy) {
+                auto cell = grid.find(CellKey{cx, cy});
+                if (cell == grid.end()) continue;
+                candidates.insert(candidates.end(), cell->second.begin(), cell->second.end());
+            }
+        }
+        size_t n = candidates.size();
+        if (n == 0) continue;
+        px.resize(n); py.resize(n); depth.resize(n); nx.resize(n); ny.resize(n);
+        for (size_t c = 0; c < n; ++c) {
+            px[c] = x[2 * candidates[c] + X];
+            py[c] = x[2 * candidates[c] + Y];
+            depth[c] = -1e30;
+        }
+
+        // Signed distance to a convex polygon (away from the corners) is the
+        // largest distance to the planes of its edges.
+        for (int k = 0; k < count; ++k) {
+            const sf::Vector2f &a = world[k], &b = world[(k + 1) % count];
+            double ex = b.x - a.x, ey = b.y - a.y;
+            double len = std::sqrt(ex * ex + ey * ey);
+            double enx = ey / len, eny = -ex / len;
+            double offset = enx * a.x + eny * a.y;
+            for (size_t c = 0; c < n; ++c) {
+                double d = enx * px[c] + eny * py[c] - offset;
+                bool further = d > depth[c];
+                depth[c] = further ? d : depth[c];
+                nx[c] = further ? enx : nx[c];
+                ny[c] = further ? eny : ny[c];
+            }
+        }
+
+        // Impulses, applied in turn so the body's velocity stays consistent.
+        const double restitution = POLYGON_RESTITUTION;
+        double invMass = body.kinematic ? 0.0 : 1.0 / body.mass;
+        double invInertia = body.kinematic ? 0.0 : 1.0 / body.inertia;
+        for (size_t c = 0; c < n; ++c) {
+            int i = candidates[c];
+            double penetration = particles[i]->radius - depth[c];
+            if (penetration <= 0.0) continue;
+            contacts++;
+
+            double rx = px[c] - nx[c] * depth[c] - body.x;
+            double ry = py[c] - ny[c] * depth[c] - body.y;
+            double bodyVx = body.vx - body.omega * ry;
+            double bodyVy = body.vy + body.omega * rx;
+            double vn = (v[2 * i + X] - bodyVx) * nx[c] + (v[2 * i + Y] - bodyVy) * ny[c];
+
+            // Push the particle out of the body.
+            x[2 * i + X] += nx[c] * penetration;
+            x[2 * i + Y] += ny[c] * penetration;
+            if (vn >= 0.0) continue;
+
+            double particleInvMass = 1.0 / particles[i]->mass;
+            double rn = cross(rx, ry, nx[c], ny[c]);
+            double k = particleInvMass + invMass + rn * rn * invInertia;
+            double j = -(1.0 + restitution) * vn / k;
+            v[2 * i + X] += j * nx[c] * particleInvMass;
+            v[2 * i + Y] += j * ny[c] * particleInvMass;
+            body.vx -= j * nx[c] * invMass;
+            body.vy -= j * ny[c] * invMass;
+            body.omega -= j * rn * invInertia;
+        }
+    }
+    return contacts;
+}
+
+void PolygonBodies::step(double dt, double gravity) {
+    for (auto &body : bodies) {
+        if (!body.kinematic) body.vy += gravity * dt;
+        body.x += body.vx * dt;
+        body.y += body.vy * dt;
+        body.angle += body.omega * dt;
+
+        if (!body.kinematic) {
+            // Bounce the deepest vertex off each wall it crossed.
+            for (int wall = 0; wall < 4; ++wall) {
+                double deepest = 0.0, rx = 0.0, ry = 0.0;
+                for (const auto &corner : body.local) {
+                    sf::Vector2f r = rotateVector(corner, body.angle);
+                    double over = wall == 0 ? -(body.x + r.x) : wall == 1 ? body.x + r.x - width
+                                : wall == 2 ? -(body.y + r.y) : body.y + r.y - height;
+                    if (over > deepest) { deepest = over; rx = r.x; ry = r.y; }
+                }
+                if (deepest <= 0.0) continue;
+                double wnx = wall == 0 ? 1.0 : wall == 1 ? -1.0 : 0.0;
+                double wny = wall == 2 ? 1.0 : wall == 3 ? -1.0 : 0.0;
+                body.x += wnx * deepest;
+                body.y += wny * deepest;
+                double vn = (body.vx - body.omega * ry) * wnx + (body.vy + body.omega * rx) * wny;
+                if (vn >= 0.0) continue;
+                double rn = cross(rx, ry, wnx, wny);
+                double j = -(1.0 + POLYGON_RESTITUTION) * vn / (1.0 / body.mass + rn * rn / body.inertia);
+                body.vx += j * wnx / body.mass;
+                body.vy += j * wny / body.mass;
+                body.omega += j * rn / body.inertia;
+            }
+        }
+        calcShape(body.shape, body.local, sf::Vector2f(body.x, body.y), static_cast<float>(body.angle));
+    }
+}
+
+void PolygonBodies::draw(sf::RenderWindow &window) {
+    for (auto &body : bodies) {
+        window.draw(body.shape);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef POLYGON_H
+#define POLYGON_H
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "matrix.h"
+#include "cellkey.h"
+#include "particle.h"
+#include "defs.h"
+
+// Convex polygon rigid body. Vertices are stored counter-clockwise (in screen
+// coordinates, y down) about the centre of mass and rotated into place each step
+// the same way the cube rotates its faces (rotateVector/calcShape).
+struct RigidPolygon {
+    std::vector<sf::Vector2f> local;
+    double x, y, angle;
+    double vx, vy, omega;
+    double mass, inertia;
+    // Kinematic bodies (paddles, mixers) follow their velocity and ignore impulses.
+    bool kinematic;
+    sf::ConvexShape shape;
+};
+
+// Polygons colliding two ways with the particles of the collision mode. Each body
+// queries the particle CellMap over its bounding box, gathers the candidates into
+// contiguous arrays and runs a branch-free signed-distance test over them, one
+// edge at a time, before applying the impulses.
+class PolygonBodies {
+public:
+    PolygonBodies(float width, float height);
+
+    std::vector<RigidPolygon> bodies;
+
+    // Add a body from vertices around (x, y); they are recentred on the centre of
+    // mass. Density is mass per unit area. Returns the body index.
+    int addPolygon(const std::vector<sf::Vector2f> &vertices, double x, double y, double density, bool kinematic);
+    int addBox(double x, double y, double w, double h, double density, bool kinematic);
+
+    // Resolve contacts with the particles, each with its own radius and mass.
+    // Returns the number of particle contacts.
+    int collide(matrix &positions, matrix &velocities, const CellMap &grid, Particle **particles);
+
+    // Integrate the bodies over dt under gravity and bounce them off the walls.
+    void step(double dt, double gravity);
+
+    void draw(sf::RenderWindow &window);
+
+private:
+    float width, height;
+
+    // Candidate particles of one body (structure of arrays).
+    std::vector<int> candidates;
+    std::vector<double> px, py, depth, nx, ny;
+};
+
+#endif // POLYGON_H
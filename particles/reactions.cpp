@@ -0,0 +1,190 @@
+#include "reactions.h"
+#include "cellkey.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#define X 0
+#define Y 1
+
+static const std::uint64_t UNCLAIMED = std::numeric_limits<std::uint64_t>::max();
+
+ReactionSystem::ReactionSystem(int count, ThreadPool &pool)
+    : count(count), pool(pool), species(count, 0), events(pool.size()), claim(count), reacted(count, 0)
+{
+    for (auto &c : claim) c.store(UNCLAIMED, std::memory_order_relaxed);
+    addSpecies(1.0f, RADIUS, sf::Color::White);
+}
+
+int ReactionSystem::addSpecies(float mass, float radius, const sf::Color &color) {
+    speciesTable.push_back({ mass, radius, color });
+    decayRule.push_back(-1);
+    // Grow the pair table, keeping the rules already in it.
+    int n = numSpecies + 1;
+    std::vector<int> table(n * n, -1);
+    for (int a = 0; a < numSpecies; ++a) {
+        for (int b = 0; b < numSpecies; ++b) table[a * n + b] = pairRule[a * numSpecies + b];
+    }
+    pairRule.swap(table);
+    numSpecies = n;
+    return n - 1;
+}
+
+void ReactionSystem::addContact(int a, int b, int c, int d, float probability) {
+    if (a < 0 || a >= numSpecies || b < 0 || b >= numSpecies || c < 0 || c >= numSpecies ||
+        d < REMOVE || d >= numSpecies) {
+        throw std::invalid_argument("Contact rule names an unknown species");
+    }
+    contactRules.push_back({ a, b, c, d, probability });
+    int rule = static_cast<int>(contactRules.size()) - 1;
+    pairRule[a * numSpecies + b] = rule;
+    pairRule[b * numSpecies + a] = rule;
+}
+
+void ReactionSystem::addDecay(int a, int b, float rate) {
+    if (a < 0 || a >= numSpecies || b < REMOVE || b >= numSpecies) {
+        throw std::invalid_argument("Decay rule names an unknown species");
+    }
+    decayRules.push_back({ a, b, rate });
+    decayRule[a] = static_cast<int>(decayRules.size()) - 1;
+}
+
+float ReactionSystem::largestRadius() const {
+    float radius = 0.0f;
+    for (const Species &sp : speciesTable) radius = std::max(radius, sp.radius);
+    return radius;
+}
+
+void ReactionSystem::become(int i, int s, Particle **particles) {
+    const Species &sp = speciesTable[s];
+    species[i] = s;
+    particles[i]->mass = sp.mass;
+    if (particles[i]->radius != sp.radius) particles[i]->setRadius(sp.radius);
+    particles[i]->color = sp.color;
+    particles[i]->shape.setFillColor(sp.color);
+}
+
+void ReactionSystem::setSpecies(int i, int s, Particle **particles) {
+    become(i, s, particles);
+}
+
+void ReactionSystem::remove(int i, double *v, double *a, Particle **particles) {
+    particles[i]->active = false;
+    v[2 * i + X] = v[2 * i + Y] = 0.0;
+    a[2 * i + X] = a[2 * i + Y] = 0.0;
+}
+
+void ReactionSystem::claimMin(int i, std::uint64_t key) {
+    std::uint64_t current = claim[i].load(std::memory_order_relaxed);
+    while (key < current && !claim[i].compare_exchange_weak(current, key, std::memory_order_relaxed)) {
+    }
+}
+
+int ReactionSystem::commit(matrix &positions, matrix &velocities, matrix &accelerations, Particle **particles,
+                           double dt) {
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+    double *a = accelerations.data.data();
+    int buffers = static_cast<int>(events.size());
+    std::vector<int> reactions(pool.size(), 0), removals(pool.size(), 0);
+
+    // Every particle keeps the smallest key among its events.
+    pool.parallelFor(buffers, [&](int start, int end) {
+        for (int t = start; t < end; ++t) {
+            for (const Event &e : events[t]) {
+                claimMin(e.i, claimKey(e.i, e.j));
+                claimMin(e.j, claimKey(e.j, e.i));
+            }
+        }
+    });
+
+    // An event holding both its particles' claims goes ahead; no other event
+    // can hold either of them, so the updates below never overlap.
+    pool.parallelFor(buffers, [&](int start, int end, unsigned thread) {
+        for (int t = start; t < end; ++t) {
+            for (const Event &e : events[t]) {
+                int i = e.i, j = e.j;
+                if (claim[i].load(std::memory_order_relaxed) != claimKey(i, j) ||
+                    claim[j].load(std::memory_order_relaxed) != claimKey(j, i)) {
+                    continue;
+                }
+                const ContactRule &rule = contactRules[e.rule];
+                reacted[i] = reacted[j] = 1;
+                reactions[thread]++;
+                if (rule.d != REMOVE) {
+                    become(i, rule.c, particles);
+                    become(j, rule.d, particles);
+                    continue;
+                }
+                // Merge j into i at the centre of mass, keeping the momentum.
+                double mi = particles[i]->mass, mj = particles[j]->mass;
+                float dx = static_cast<float>(x[2 * j + X] - x[2 * i + X]);
+                float dy = static_cast<float>(x[2 * j + Y] - x[2 * i + Y]);
+                minimumImage<PERIODIC_X, PERIODIC_Y>(dx, dy);
+                double px = mi * v[2 * i + X] + mj * v[2 * j + X];
+                double py = mi * v[2 * i + Y] + mj * v[2 * j + Y];
+                x[2 * i + X] += mj / (mi + mj) * dx;
+                x[2 * i + Y] += mj / (mi + mj) * dy;
+                become(i, rule.c, particles);
+                v[2 * i + X] = px / particles[i]->mass;
+                v[2 * i + Y] = py / particles[i]->mass;
+                particles[i]->syncShape();
+                remove(j, v, a, particles);
+                removals[thread]++;
+            }
+        }
+    });
+
+    pool.parallelFor(buffers, [&](int start, int end) {
+        for (int t = start; t < end; ++t) {
+            for (const Event &e : events[t]) {
+                claim[e.i].store(UNCLAIMED, std::memory_order_relaxed);
+                claim[e.j].store(UNCLAIMED, std::memory_order_relaxed);
+            }
+        }
+    });
+    for (auto &buffer : events) buffer.clear();
+
+    // Decays, drawn per (particle, step) from their own stream.
+    const std::uint64_t decaySeed = mix64(seed);
+    pool.parallelFor(count, [&](int start, int end, unsigned thread) {
+        for (int i = start; i < end; ++i) {
+            if (reacted[i]) {
+                reacted[i] = 0;
+                continue;
+            }
+            int rule = decayRule[species[i]];
+            if (rule < 0 || !particles[i]->active) continue;
+            double p = 1.0 - std::exp(-decayRules[rule].rate * dt);
+            if (toUniform(counterHash(decaySeed, static_cast<std::uint64_t>(i), step)) >= p) continue;
+            reactions[thread]++;
+            if (decayRules[rule].b == REMOVE) {
+                remove(i, v, a, particles);
+                removals[thread]++;
+            } else {
+                become(i, decayRules[rule].b, particles);
+            }
+        }
+    });
+    step++;
+
+    int total = 0;
+    for (size_t t = 0; t < reactions.size(); ++t) {
+        total += reactions[t];
+        removed += removals[t];
+    }
+    return total;
+}
+
+void ReactionSystem::permute(const std::vector<int> &order, Particle **particles) {
+    std::vector<int> old(species);
+    for (int k = 0; k < count; ++k) {
+        species[k] = old[order[k]];
+        if (species[k] != old[k]) {
+            particles[k]->color = speciesTable[species[k]].color;
+            particles[k]->shape.setFillColor(particles[k]->color);
+        }
+    }
+}
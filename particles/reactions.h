@@ -0,0 +1,104 @@
+#ifndef REACTIONS_H
+#define REACTIONS_H
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "matrix.h"
+#include "particle.h"
+#include "rng.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Species reactions for the collision mode.
+//  - Contact rules A + B -> C + D fire with a probability per step while an A
+//    and a B touch. The A particle becomes C; the B particle becomes D or, with
+//    D = REMOVE, is removed and C takes the pair's mass-weighted centre and
+//    momentum (agglomeration).
+//  - Decay rules A -> B fire at a rate (1/s); B may be REMOVE.
+// A species sets a particle's mass, radius and colour.
+//
+// The contact pass only records candidate events, into a buffer per thread.
+// commit() then resolves them so every particle reacts at most once per step:
+// each particle keeps the smallest key of its events by an atomic min, and an
+// event goes ahead when it holds the key of both its particles. Keys are hashed
+// from the pair and the step, so the outcome does not depend on the thread split
+// or the order events were found in. Accepted events touch disjoint particles
+// and are applied in one batch, followed by the decays.
+class ReactionSystem {
+public:
+    static const int REMOVE = -1;
+
+    ReactionSystem(int count, ThreadPool &pool);
+
+    // Species 0 exists from the start and is inert unless rules name it.
+    int addSpecies(float mass, float radius, const sf::Color &color);
+    void addContact(int a, int b, int c, int d, float probability);
+    void addDecay(int a, int b, float rate);
+
+    void setSpecies(int i, int s, Particle **particles);
+    int speciesOf(int i) const { return species[i]; }
+    // Largest radius of the species so far.
+    float largestRadius() const;
+
+    std::uint64_t seed = REACTION_SEED;
+
+    // Called by the contact pass for touching particles i and j.
+    void contact(unsigned thread, int i, int j) {
+        int rule = pairRule[species[i] * numSpecies + species[j]];
+        if (rule < 0) return;
+        std::uint64_t bits = counterHash(seed, pairKey(i, j), step);
+        if (toUniform(bits) >= contactRules[rule].probability) return;
+        if (species[i] != contactRules[rule].a) std::swap(i, j);
+        events[thread].push_back({ i, j, rule });
+    }
+
+    // Resolve this step's events and apply them with the decays over dt. Returns
+    // the number of reactions.
+    int commit(matrix &positions, matrix &velocities, matrix &accelerations, Particle **particles, double dt);
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k]. Mass, radius and activity are moved by the adaptive
+    // resolution's permute; this moves the species and repaints.
+    void permute(const std::vector<int> &order, Particle **particles);
+
+    int removedCount() const { return removed; }
+
+private:
+    struct Species { float mass; float radius; sf::Color color; };
+    struct ContactRule { int a, b, c, d; float probability; };
+    struct DecayRule { int a, b; float rate; };
+    struct Event { int i, j, rule; };
+
+    static std::uint64_t pairKey(int i, int j) {
+        return (static_cast<std::uint64_t>(std::min(i, j)) << 32) | static_cast<std::uint64_t>(std::max(i, j));
+    }
+    // Claim of event (i, j) on particle i: pair priority above, partner below.
+    std::uint64_t claimKey(int i, int j) const {
+        return (mix64(counterHash(seed, pairKey(i, j), step)) & 0xffffffff00000000ULL) | static_cast<std::uint32_t>(j);
+    }
+    void claimMin(int i, std::uint64_t key);
+    void become(int i, int s, Particle **particles);
+    void remove(int i, double *v, double *a, Particle **particles);
+
+    int count;
+    ThreadPool &pool;
+    int removed = 0;
+    std::uint64_t step = 0;
+
+    std::vector<Species> speciesTable;
+    std::vector<ContactRule> contactRules;
+    std::vector<int> decayRule;             // per species, -1 for none
+    std::vector<DecayRule> decayRules;
+    int numSpecies = 0;
+    std::vector<int> pairRule;              // numSpecies^2, -1 for none
+
+    std::vector<int> species;
+    std::vector<std::vector<Event>> events; // per thread
+    std::vector<std::atomic<std::uint64_t>> claim;
+    std::vector<char> reacted;
+};
+
+#endif // REACTIONS_H
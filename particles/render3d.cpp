@@ -0,0 +1,67 @@
+#include "render3d.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define X 0
+#define Y 1
+#define Z 2
+
+// --- Isometric projection (as in cube/face.cpp) ---
+static sf::Vector2f project(const sf::Vector3f &point) {
+    float angle = 30.f * 3.14159265f / 180.f;
+    float cosA = std::cos(angle);
+    float sinA = std::sin(angle);
+    float x2d = (point.x - point.z) * cosA;
+    float y2d = point.y + (point.x + point.z) * sinA;
+    return sf::Vector2f(x2d, y2d);
+}
+
+IsometricRenderer::IsometricRenderer(sf::Vector2f origin, float scale, float radius, float maxDepth, int buckets)
+    : origin(origin), scale(scale), radius(radius), maxDepth(maxDepth), buckets(buckets),
+      vertices(sf::PrimitiveType::Triangles)
+{
+    bucketStart.assign(buckets + 1, 0);
+}
+
+void IsometricRenderer::draw(sf::RenderWindow &window, const matrix &positions) {
+    int n = positions.rows;
+    const double *p = positions.data.data();
+
+    // The projection flattens the direction (1, -1, 1), which points at the
+    // viewer (up is -y): larger x - y + z is nearer. Bucket by that and emit far
+    // buckets first.
+    order.resize(n);
+    bucketOf.resize(n);
+    std::fill(bucketStart.begin(), bucketStart.end(), 0);
+    for (int i = 0; i < n; ++i) {
+        double nearness = p[3 * i + X] - p[3 * i + Y] + p[3 * i + Z];
+        int b = static_cast<int>((nearness + maxDepth) / (3.0 * maxDepth) * buckets);
+        b = std::clamp(b, 0, buckets - 1);
+        bucketOf[i] = b;
+        bucketStart[b + 1]++;
+    }
+    for (int b = 0; b < buckets; ++b) bucketStart[b + 1] += bucketStart[b];
+    for (int i = 0; i < n; ++i) order[bucketStart[bucketOf[i]]++] = i;
+
+    // Each particle is a small screen-aligned square, shaded by height.
+    vertices.resize(6 * static_cast<size_t>(n));
+    float half = radius * scale;
+    for (int k = 0; k < n; ++k) {
+        int i = order[k];
+        sf::Vector3f point(static_cast<float>(p[3 * i + X]), static_cast<float>(p[3 * i + Y]),
+                           static_cast<float>(p[3 * i + Z]));
+        sf::Vector2f c = origin + project(point) * scale;
+        auto shade = static_cast<std::uint8_t>(std::clamp(255.0 - 155.0 * point.y / maxDepth, 60.0, 255.0));
+        sf::Color color(shade, shade, 255);
+        sf::Vector2f corners[4] = { c + sf::Vector2f(-half, -half), c + sf::Vector2f(half, -half),
+                                    c + sf::Vector2f(half, half), c + sf::Vector2f(-half, half) };
+        const int fan[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int t = 0; t < 6; ++t) {
+            vertices[6 * k + t].position = corners[fan[t]];
+            vertices[6 * k + t].color = color;
+        }
+    }
+    window.draw(vertices);
+}
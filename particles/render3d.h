@@ -0,0 +1,27 @@
+#ifndef RENDER3D_H
+#define RENDER3D_H
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "matrix.h"
+
+// Draws an (n x 3) positions matrix with the cube's isometric projection. All
+// particles go into one vertex array, ordered back to front with a counting sort
+// on quantised depth, so the whole frame is a single draw call.
+class IsometricRenderer {
+public:
+    IsometricRenderer(sf::Vector2f origin, float scale, float radius, float maxDepth, int buckets);
+
+    void draw(sf::RenderWindow &window, const matrix &positions);
+
+private:
+    sf::Vector2f origin;
+    float scale, radius, maxDepth;
+    int buckets;
+    std::vector<int> bucketStart;
+    std::vector<int> order;
+    std::vector<int> bucketOf;
+    sf::VertexArray vertices;
+};
+
+#endif // RENDER3D_H
@@ -0,0 +1,109 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Counter-based random numbers: every draw is a pure hash of (seed, stream,
+// counter), with no generator state to share or advance. Any thread can produce
+// the numbers of any particle and step in any order and get the same values.
+// gaussianBlock() draws the normals of a block of streams in loops of plain
+// arithmetic, with its own log and sincos, so the compiler vectorises them; the
+// scalar functions go through libm and do not.
+
+// SplitMix64 finaliser: a bijective mix of all 64 bits.
+inline std::uint64_t mix64(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// 64 random bits for draw `counter` of stream `stream`.
+inline std::uint64_t counterHash(std::uint64_t seed, std::uint64_t stream, std::uint64_t counter) {
+    return mix64(mix64(seed ^ (stream * 0x9e3779b97f4a7c15ULL)) + counter);
+}
+
+// Uniform in (0, 1): the top 53 bits, offset by half a step so 0 never comes up.
+inline double toUniform(std::uint64_t bits) {
+    return (static_cast<double>(bits >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// Two independent standard normals for (stream, counter) by Box-Muller.
+inline void gaussianPair(std::uint64_t seed, std::uint64_t stream, std::uint64_t counter, double &g1, double &g2) {
+    std::uint64_t bits = counterHash(seed, stream, counter);
+    double u1 = toUniform(bits);
+    double u2 = toUniform(mix64(bits));
+    double r = std::sqrt(-2.0 * std::log(u1));
+    double angle = 6.283185307179586 * u2;
+    g1 = r * std::cos(angle);
+    g2 = r * std::sin(angle);
+}
+
+// Streams per gaussianBlock() call.
+const int GAUSSIAN_BLOCK = 64;
+
+inline double bitsToDouble(std::uint64_t bits) {
+    double d;
+    std::memcpy(&d, &bits, sizeof d);
+    return d;
+}
+
+inline std::uint64_t doubleToBits(double d) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof bits);
+    return bits;
+}
+
+// Uniform in (0, 1) from the top 52 bits, built in the mantissa of [1, 2) so it
+// needs no integer to double conversion.
+inline double toUniformBits(std::uint64_t bits) {
+    return bitsToDouble((bits >> 12) | 0x3ff0000000000000ULL) - (1.0 - 0.5 / 4503599627370496.0);
+}
+
+// Standard normals g[2k], g[2k + 1] of streams stream0 + k, k < GAUSSIAN_BLOCK,
+// for draw `counter` by Box-Muller. Not the same numbers as gaussianPair().
+inline void gaussianBlock(std::uint64_t seed, std::uint64_t stream0, std::uint64_t counter, double *g) {
+    std::uint64_t first[GAUSSIAN_BLOCK], second[GAUSSIAN_BLOCK];
+    double radius[GAUSSIAN_BLOCK];
+    // 64-bit multiplies: vector code needs AVX2 or better.
+    for (int k = 0; k < GAUSSIAN_BLOCK; ++k) {
+        first[k] = counterHash(seed, stream0 + k, counter);
+        second[k] = mix64(first[k]);
+    }
+    // r = sqrt(-2 log u): u = 2^e m with e a half-integer and m in
+    // [sqrt(1/2), sqrt(2)), and log m = 2 atanh(s), s = (m - 1) / (m + 1),
+    // |s| < 0.172, by its series.
+    // The exponent goes to a double by the 2^52 trick and the root by Newton's
+    // method on the inverse root from its bit-trick guess, since neither a
+    // 64-bit integer conversion nor std::sqrt (which may set errno) vectorises.
+    for (int k = 0; k < GAUSSIAN_BLOCK; ++k) {
+        std::uint64_t b = doubleToBits(toUniformBits(first[k]));
+        double e = bitsToDouble(0x4330000000000000ULL | (b >> 52)) - (4503599627370496.0 + 1023.0) + 0.5;
+        double m = bitsToDouble((b & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL) * 0.7071067811865476;
+        double s = (m - 1.0) / (m + 1.0);
+        double s2 = s * s;
+        double series = 1.0 + s2 * (1.0 / 3 + s2 * (1.0 / 5 + s2 * (1.0 / 7 + s2 * (1.0 / 9 + s2 * (1.0 / 11 + s2 * (1.0 / 13 + s2 * (1.0 / 15)))))));
+        // |.| keeps rounding near u = 1 from going negative.
+        double r2 = std::fabs(-2.0 * (e * 0.6931471805599453 + 2.0 * s * series));
+        double y = bitsToDouble(0x5fe6eb50c7b537a9ULL - (doubleToBits(r2) >> 1));
+        y *= 1.5 - 0.5 * r2 * y * y;
+        y *= 1.5 - 0.5 * r2 * y * y;
+        y *= 1.5 - 0.5 * r2 * y * y;
+        y *= 1.5 - 0.5 * r2 * y * y;
+        radius[k] = r2 * y;
+    }
+    // The angle 2 pi u as twice x = pi (u - 1/2) in (-pi/2, pi/2), with sin x and
+    // cos x by their Taylor series; that turns the pair by pi, which a normal
+    // pair does not notice.
+    for (int k = 0; k < GAUSSIAN_BLOCK; ++k) {
+        double x = 3.141592653589793 * (toUniformBits(second[k]) - 0.5);
+        double x2 = x * x;
+        double sin = x * (1.0 - x2 / 6 * (1.0 - x2 / 20 * (1.0 - x2 / 42 * (1.0 - x2 / 72 * (1.0 - x2 / 110 * (1.0 - x2 / 156 * (1.0 - x2 / 210)))))));
+        double cos = 1.0 - x2 / 2 * (1.0 - x2 / 12 * (1.0 - x2 / 30 * (1.0 - x2 / 56 * (1.0 - x2 / 90 * (1.0 - x2 / 132 * (1.0 - x2 / 182 * (1.0 - x2 / 240)))))));
+        g[2 * k] = radius[k] * (cos * cos - sin * sin);
+        g[2 * k + 1] = radius[k] * (2.0 * sin * cos);
+    }
+}
+
+#endif // RNG_H
@@ -0,0 +1,118 @@
+#include "sdf.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+ObstacleField::ObstacleField(float width, float height, float spacing) : spacing(spacing) {
+    nx = static_cast<int>(std::ceil(width / spacing)) + 1;
+    ny = static_cast<int>(std::ceil(height / spacing)) + 1;
+    distance.assign(nx * ny, 1e30);
+    cellsX = static_cast<int>(width) / CELL_SIZE + 1;
+    cellsY = static_cast<int>(height) / CELL_SIZE + 1;
+    nearCell.assign(cellsX * cellsY, 0);
+}
+
+void ObstacleField::addCircle(float cx, float cy, float r) {
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
+            double d = std::hypot(i * spacing - cx, j * spacing - cy) - r;
+            distance[j * nx + i] = std::min(distance[j * nx + i], d);
+        }
+    }
+    sf::CircleShape shape(r);
+    shape.setOrigin(sf::Vector2f(r, r));
+    shape.setPosition(sf::Vector2f(cx, cy));
+    shape.setFillColor(sf::Color(90, 90, 90));
+    circles.push_back(shape);
+}
+
+void ObstacleField::addPolygon(const std::vector<sf::Vector2f> &vertices) {
+    int count = static_cast<int>(vertices.size());
+    for (int j = 0; j < ny; ++j) {
+        for (int i = 0; i < nx; ++i) {
+            double px = i * spacing, py = j * spacing;
+            // Distance to the nearest edge; the sign from a crossing count.
+            double best = 1e30;
+            bool inside = false;
+            for (int k = 0, prev = count - 1; k < count; prev = k++) {
+                const sf::Vector2f &a = vertices[prev], &b = vertices[k];
+                double ex = b.x - a.x, ey = b.y - a.y;
+                double wx = px - a.x, wy = py - a.y;
+                double t = std::clamp((wx * ex + wy * ey) / (ex * ex + ey * ey), 0.0, 1.0);
+                best = std::min(best, std::hypot(wx - t * ex, wy - t * ey));
+                if ((a.y > py) != (b.y > py) && px < a.x + (py - a.y) * ex / ey) inside = !inside;
+            }
+            double d = inside ? -best : best;
+            distance[j * nx + i] = std::min(distance[j * nx + i], d);
+        }
+    }
+    sf::ConvexShape shape(count);
+    for (int k = 0; k < count; ++k) shape.setPoint(k, vertices[k]);
+    shape.setFillColor(sf::Color(90, 90, 90));
+    outlines.push_back(shape);
+}
+
+void ObstacleField::addBox(float cx, float cy, float w, float h, float angle) {
+    float cosA = std::cos(angle), sinA = std::sin(angle);
+    std::vector<sf::Vector2f> corners;
+    for (auto corner : { sf::Vector2f(-w, -h), sf::Vector2f(w, -h), sf::Vector2f(w, h), sf::Vector2f(-w, h) }) {
+        corners.push_back(sf::Vector2f(cx + 0.5f * (corner.x * cosA - corner.y * sinA),
+                                       cy + 0.5f * (corner.x * sinA + corner.y * cosA)));
+    }
+    addPolygon(corners);
+}
+
+void ObstacleField::flagCells(float maxRadius) {
+    // The field is 1-Lipschitz, so a cell whose centre is further from every
+    // obstacle than its half diagonal plus a particle radius holds no contacts.
+    double reach = 0.7072 * CELL_SIZE + maxRadius + spacing;
+    for (int cy = 0; cy < cellsY; ++cy) {
+        for (int cx = 0; cx < cellsX; ++cx) {
+            double gx, gy;
+            double d = sample((cx + 0.5) * CELL_SIZE, (cy + 0.5) * CELL_SIZE, gx, gy);
+            nearCell[cy * cellsX + cx] = d < reach;
+        }
+    }
+}
+
+bool ObstacleField::isNear(const CellKey &key) const {
+    if (key.x < 0 || key.x >= cellsX || key.y < 0 || key.y >= cellsY) return false;
+    return nearCell[key.y * cellsX + key.x];
+}
+
+double ObstacleField::sample(double x, double y, double &gx, double &gy) const {
+    double fx = std::clamp(x / spacing, 0.0, nx - 1.0001);
+    double fy = std::clamp(y / spacing, 0.0, ny - 1.0001);
+    int i = static_cast<int>(fx), j = static_cast<int>(fy);
+    double tx = fx - i, ty = fy - j;
+    const double *row = &distance[j * nx + i];
+    double d00 = row[0], d10 = row[1], d01 = row[nx], d11 = row[nx + 1];
+    gx = ((d10 - d00) * (1 - ty) + (d11 - d01) * ty) / spacing;
+    gy = ((d01 - d00) * (1 - tx) + (d11 - d10) * tx) / spacing;
+    return (d00 * (1 - tx) + d10 * tx) * (1 - ty) + (d01 * (1 - tx) + d11 * tx) * ty;
+}
+
+bool ObstacleField::collide(double *pos, double *vel, float radius) const {
+    double gx, gy;
+    double d = sample(pos[X], pos[Y], gx, gy);
+    if (d >= radius) return false;
+    double norm = std::sqrt(gx * gx + gy * gy);
+    if (norm == 0.0) return false;
+    double nx = gx / norm, ny = gy / norm;
+    pos[X] += (radius - d) * nx;
+    pos[Y] += (radius - d) * ny;
+    double vn = vel[X] * nx + vel[Y] * ny;
+    if (vn < 0.0) {
+        vel[X] -= (2.0 - ENTROPY) * vn * nx;
+        vel[Y] -= (2.0 - ENTROPY) * vn * ny;
+    }
+    return true;
+}
+
+void ObstacleField::draw(sf::RenderWindow &window) {
+    for (auto &shape : outlines) window.draw(shape);
+    for (auto &shape : circles) window.draw(shape);
+}
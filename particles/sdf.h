@@ -0,0 +1,47 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include "cellkey.h"
+#include "defs.h"
+
+// Static obstacles as a signed distance field, positive in free space. Shapes are
+// baked into one grid of node distances (union = min), so a particle costs one
+// bilinear lookup no matter how many shapes there are. Collision cells that
+// cannot reach an obstacle are flagged off so most particles skip even that.
+class ObstacleField {
+public:
+    // Nodes every `spacing` pixels over the window.
+    ObstacleField(float width, float height, float spacing);
+
+    void addCircle(float cx, float cy, float r);
+    // Convex outline, any winding.
+    void addPolygon(const std::vector<sf::Vector2f> &vertices);
+    void addBox(float cx, float cy, float w, float h, float angle);
+
+    // Recompute the near-obstacle flags of the CELL_SIZE collision cells for
+    // particles up to maxRadius. Call after adding shapes.
+    void flagCells(float maxRadius);
+    bool isNear(const CellKey &key) const;
+
+    // Bilinear distance and its gradient at (x, y).
+    double sample(double x, double y, double &gx, double &gy) const;
+
+    // Push a particle out of any obstacle it overlaps and reflect its normal
+    // velocity like the window walls do. Returns true on contact.
+    bool collide(double *pos, double *vel, float radius) const;
+
+    void draw(sf::RenderWindow &window);
+
+private:
+    int nx, ny;
+    float spacing;
+    std::vector<double> distance;
+    int cellsX, cellsY;
+    std::vector<char> nearCell;
+    std::vector<sf::ConvexShape> outlines;
+    std::vector<sf::CircleShape> circles;
+};
+
+#endif // SDF_H
@@ -0,0 +1,171 @@
+#include "shapematch.h"
+
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+// Grow a per-cluster table by whole rows, keeping its contents.
+static void resizeRows(matrix &m, int rows) {
+    m.rows = rows;
+    m.data.resize(static_cast<size_t>(rows) * m.cols, 0.0);
+}
+
+ShapeMatching::ShapeMatching(ThreadPool &pool) : pool(pool) {}
+
+int ShapeMatching::addCluster(const matrix &positions, const std::vector<int> &particles) {
+    int c = clusterCount();
+    double cx = 0.0, cy = 0.0;
+    for (int i : particles) {
+        cx += positions(i, X);
+        cy += positions(i, Y);
+    }
+    cx /= particles.size();
+    cy /= particles.size();
+
+    double qxx = 0.0, qxy = 0.0, qyy = 0.0;
+    for (int i : particles) {
+        double qx = positions(i, X) - cx, qy = positions(i, Y) - cy;
+        members.push_back(i);
+        restOffset.push_back(qx);
+        restOffset.push_back(qy);
+        qxx += qx * qx;
+        qxy += qx * qy;
+        qyy += qy * qy;
+    }
+    clusterStart.push_back(static_cast<int>(members.size()));
+
+    for (matrix *m : {&centroid, &meanVelocity, &spin, &covariance, &restInverse, &transform, &rotation}) {
+        resizeRows(*m, c + 1);
+    }
+    // Aqq is singular for a line of particles; those clusters only rotate.
+    double det = qxx * qyy - qxy * qxy;
+    if (det > 1e-12) {
+        restInverse(c, 0) = qyy / det;
+        restInverse(c, 1) = -qxy / det;
+        restInverse(c, 2) = -qxy / det;
+        restInverse(c, 3) = qxx / det;
+    }
+    return c;
+}
+
+double ShapeMatching::angle(int c) const {
+    return std::atan2(rotation(c, 2), rotation(c, 0));
+}
+
+void ShapeMatching::apply(const matrix &positions, matrix &velocities, double dt) {
+    int clusters = clusterCount();
+    if (clusters == 0 || dt <= 0.0) return;
+    const double *x = positions.data.data();
+    double *v = velocities.data.data();
+    const double *q = restOffset.data();
+
+    // Centroid, mean velocity, covariance and angular momentum of every cluster.
+    pool.parallelFor(clusters, [&](int start, int end) {
+        for (int c = start; c < end; ++c) {
+            int first = clusterStart[c], last = clusterStart[c + 1];
+            double inv = 1.0 / (last - first);
+            double cx = 0.0, cy = 0.0, vx = 0.0, vy = 0.0;
+            for (int k = first; k < last; ++k) {
+                int i = members[k];
+                cx += x[2 * i + X];
+                cy += x[2 * i + Y];
+                vx += v[2 * i + X];
+                vy += v[2 * i + Y];
+            }
+            cx *= inv; cy *= inv; vx *= inv; vy *= inv;
+
+            double a00 = 0.0, a01 = 0.0, a10 = 0.0, a11 = 0.0;
+            double momentum = 0.0, moment = 0.0;
+            for (int k = first; k < last; ++k) {
+                int i = members[k];
+                double rx = x[2 * i + X] - cx, ry = x[2 * i + Y] - cy;
+                a00 += rx * q[2 * k + X];
+                a01 += rx * q[2 * k + Y];
+                a10 += ry * q[2 * k + X];
+                a11 += ry * q[2 * k + Y];
+                momentum += rx * (v[2 * i + Y] - vy) - ry * (v[2 * i + X] - vx);
+                moment += rx * rx + ry * ry;
+            }
+            centroid(c, X) = cx;
+            centroid(c, Y) = cy;
+            meanVelocity(c, X) = vx;
+            meanVelocity(c, Y) = vy;
+            spin(c, 0) = momentum;
+            spin(c, 1) = moment;
+            covariance(c, 0) = a00;
+            covariance(c, 1) = a01;
+            covariance(c, 2) = a10;
+            covariance(c, 3) = a11;
+        }
+    });
+
+    // Batched 2x2 math over all clusters. In 2D the rotation of the polar
+    // decomposition of A is the normalised (a00 + a11, a10 - a01) direction; the
+    // linear map A Aqq^-1 is rescaled to unit determinant to keep the area.
+    const double *A = covariance.data.data();
+    const double *Qi = restInverse.data.data();
+    double *R = rotation.data.data();
+    double *T = transform.data.data();
+    const double beta = deformation;
+    pool.parallelFor(clusters, [&](int start, int end) {
+        for (int c = start; c < end; ++c) {
+            const double *a = A + 4 * c, *qi = Qi + 4 * c;
+            double cosine = a[0] + a[3];
+            double sine = a[2] - a[1];
+            double norm = std::sqrt(cosine * cosine + sine * sine);
+            double invNorm = norm > 0.0 ? 1.0 / norm : 0.0;
+            cosine = norm > 0.0 ? cosine * invNorm : 1.0;
+            sine *= invNorm;
+            R[4 * c] = cosine;
+            R[4 * c + 1] = -sine;
+            R[4 * c + 2] = sine;
+            R[4 * c + 3] = cosine;
+
+            double l00 = a[0] * qi[0] + a[1] * qi[2];
+            double l01 = a[0] * qi[1] + a[1] * qi[3];
+            double l10 = a[2] * qi[0] + a[3] * qi[2];
+            double l11 = a[2] * qi[1] + a[3] * qi[3];
+            double det = l00 * l11 - l01 * l10;
+            bool usable = det > 1e-12;
+            double scale = 1.0 / std::sqrt(usable ? det : 1.0);
+            double b = usable ? beta : 0.0;
+            T[4 * c] = b * scale * l00 + (1.0 - b) * cosine;
+            T[4 * c + 1] = b * scale * l01 - (1.0 - b) * sine;
+            T[4 * c + 2] = b * scale * l10 + (1.0 - b) * sine;
+            T[4 * c + 3] = b * scale * l11 + (1.0 - b) * cosine;
+        }
+    });
+
+    // Blend each member's velocity towards the cluster's rigid motion and add the
+    // correction that lands it on its goal position next frame.
+    const double alpha = stiffness;
+    pool.parallelFor(clusters, [&](int start, int end) {
+        for (int c = start; c < end; ++c) {
+            const double *t = T + 4 * c;
+            double cx = centroid(c, X), cy = centroid(c, Y);
+            double vx = meanVelocity(c, X), vy = meanVelocity(c, Y);
+            double omega = spin(c, 1) > 0.0 ? spin(c, 0) / spin(c, 1) : 0.0;
+            for (int k = clusterStart[c]; k < clusterStart[c + 1]; ++k) {
+                int i = members[k];
+                double gx = cx + t[0] * q[2 * k + X] + t[1] * q[2 * k + Y];
+                double gy = cy + t[2] * q[2 * k + X] + t[3] * q[2 * k + Y];
+                double rx = x[2 * i + X] - cx, ry = x[2 * i + Y] - cy;
+                double rigidX = vx - omega * ry;
+                double rigidY = vy + omega * rx;
+                v[2 * i + X] += alpha * (rigidX - v[2 * i + X] + (gx - x[2 * i + X]) / dt);
+                v[2 * i + Y] += alpha * (rigidY - v[2 * i + Y] + (gy - x[2 * i + Y]) / dt);
+            }
+        }
+    });
+}
+
+void ShapeMatching::permute(const std::vector<int> &order) {
+    std::vector<int> newIndex(order.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        newIndex[order[k]] = static_cast<int>(k);
+    }
+    for (int &i : members) {
+        i = newIndex[i];
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SHAPEMATCH_H
+#define SHAPEMATCH_H
+
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Rigid and semi-rigid bodies made of ordinary particles by shape matching.
+// Each frame every cluster finds the rotation that best maps its rest shape onto
+// the current positions (polar decomposition of the 2x2 covariance Apq), and its
+// particles are pulled towards the matched goal positions. Per-cluster sums and
+// the small-matrix math run in separate passes over all clusters, the latter on
+// one (clusters x 4) matrix per quantity so the loop is branch free.
+class ShapeMatching {
+public:
+    explicit ShapeMatching(ThreadPool &pool);
+
+    // 1 makes clusters rigid; lower values let them flex and wobble back.
+    double stiffness = SHAPE_STIFFNESS;
+    // Blend of the best linear map into the goal (0 = rigid rotation only).
+    double deformation = SHAPE_DEFORMATION;
+
+    // Add a cluster with the current positions of its members as rest shape.
+    // Particles must belong to at most one cluster. Returns the cluster index.
+    int addCluster(const matrix &positions, const std::vector<int> &particles);
+
+    // Move velocities towards the rigid motion of each cluster and correct the
+    // positions towards the goal over a frame of length dt.
+    void apply(const matrix &positions, matrix &velocities, double dt);
+
+    // Follow a reorder of the particle storage (new particle k is old order[k]).
+    void permute(const std::vector<int> &order);
+
+    int clusterCount() const { return static_cast<int>(clusterStart.size()) - 1; }
+    // Rotation angle of cluster c relative to its rest shape, from the last apply().
+    double angle(int c) const;
+
+private:
+    ThreadPool &pool;
+
+    // Members of cluster c are [clusterStart[c], clusterStart[c + 1]) in members,
+    // with their rest offsets from the rest centroid in restOffset (x, y pairs).
+    std::vector<int> clusterStart{0};
+    std::vector<int> members;
+    std::vector<double> restOffset;
+
+    // Per-cluster quantities; 2x2 matrices are stored row major in 4 columns.
+    matrix centroid{0, DIMENSION};
+    matrix meanVelocity{0, DIMENSION};
+    matrix spin{0, 2};         // angular momentum, polar moment
+    matrix covariance{0, 4};   // Apq
+    matrix restInverse{0, 4};  // Aqq^-1
+    matrix transform{0, 4};    // goal map
+    matrix rotation{0, 4};
+};
+
+#endif // SHAPEMATCH_H
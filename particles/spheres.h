@@ -0,0 +1,189 @@
+#ifndef SPHERES_H
+#define SPHERES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+#include "matrix.h"
+#include "threadpool.h"
+#include "cblas.h"
+#include "defs.h"
+
+// Impulse-based sphere collisions in D dimensions, the same response as the 2D
+// collision mode (relative normal velocity exchanged, scaled by 1 - ENTROPY) plus
+// a positional split of any overlap so piles hold up. Everything is templated on
+// D, so the 2D instantiation carries no 3D arithmetic. Axis 1 is down.
+//
+// The 2D collision mode in main.cpp keeps its own kernel on purpose and does not
+// run on ImpulseSpheres<2>: that pass reads each particle's radius, mass and
+// active flag, wraps across periodic axes, and feeds its contacts to the thermal,
+// reaction, cluster and diagnostics hooks, none of which this equal-sphere solver
+// has. ImpulseSpheres<2> is what bench spheres compares against the 3D case.
+template <int D>
+class ImpulseSpheres {
+public:
+    ImpulseSpheres(const std::array<float, D> &box, float radius, ThreadPool &pool)
+        : box(box), radius(radius), pool(pool)
+    {
+        int cells = 1;
+        for (int d = 0; d < D; ++d) {
+            dims[d] = std::max(1, static_cast<int>(box[d] / (2.0f * radius)));
+            cellSize[d] = box[d] / dims[d];
+            stride[d] = cells;
+            cells *= dims[d];
+        }
+        cellStart.assign(cells + 1, 0);
+
+        // Forward half of the 3^D stencil: offsets whose last non-zero component
+        // is positive. Together with the home cell each neighbouring pair of cells
+        // is visited once.
+        int total = 1;
+        for (int d = 0; d < D; ++d) total *= 3;
+        for (int code = 0; code < total; ++code) {
+            std::array<int, D> offset;
+            int rest = code;
+            for (int d = 0; d < D; ++d) {
+                offset[d] = rest % 3 - 1;
+                rest /= 3;
+            }
+            int last = 0;
+            for (int d = D - 1; d >= 0 && last == 0; --d) last = offset[d];
+            if (last > 0) halfStencil.push_back(offset);
+        }
+    }
+
+    int iterations = D3_ITERATIONS;
+
+    // Integrate under gravity along axis 1, bounce off the box, then resolve contacts.
+    void step(matrix &positions, matrix &velocities, double dt, double gravity) {
+        int n = positions.rows;
+        double *x = positions.data.data();
+        double *v = velocities.data.data();
+
+        cblas_daxpy(n * D, dt, v, 1, x, 1);
+        pool.parallelFor(n, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                v[D * i + 1] += gravity * dt;
+                for (int d = 0; d < D; ++d) {
+                    double &p = x[D * i + d], &u = v[D * i + d];
+                    double damp = d == 1 ? 1.0 - ENTROPY : 1.0;
+                    if (p < radius) { p = radius; if (u < 0) u = -u * damp; }
+                    if (p > box[d] - radius) { p = box[d] - radius; if (u > 0) u = -u * damp; }
+                }
+            }
+        });
+
+        // Contacts are bucketed once; the extra sweeps only relax the overlaps
+        // deep in a pile that one pass leaves behind.
+        build(positions);
+        for (int sweep = 0; sweep < iterations; ++sweep) collide(x, v);
+    }
+
+private:
+    void build(const matrix &positions) {
+        int n = positions.rows;
+        particleCell.resize(n);
+        cellParticles.resize(n);
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+        for (int i = 0; i < n; ++i) {
+            int c = 0;
+            for (int d = 0; d < D; ++d) {
+                int k = static_cast<int>(positions.data[D * i + d] / cellSize[d]);
+                c += std::clamp(k, 0, dims[d] - 1) * stride[d];
+            }
+            particleCell[i] = c;
+            cellStart[c + 1]++;
+        }
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        for (int i = 0; i < n; ++i) cellParticles[fill[particleCell[i]]++] = i;
+    }
+
+    void resolvePair(double *x, double *v, int i, int j) const {
+        double delta[D];
+        double dist2 = 0.0;
+        for (int d = 0; d < D; ++d) {
+            delta[d] = x[D * j + d] - x[D * i + d];
+            dist2 += delta[d] * delta[d];
+        }
+        double radiusSum = 2.0 * radius;
+        if (dist2 >= radiusSum * radiusSum || dist2 == 0.0) return;
+        double dist = std::sqrt(dist2);
+        double relVel = 0.0;
+        for (int d = 0; d < D; ++d) {
+            delta[d] /= dist;
+            relVel += (v[D * i + d] - v[D * j + d]) * delta[d];
+        }
+        double push = 0.5 * (radiusSum - dist);
+        for (int d = 0; d < D; ++d) {
+            x[D * i + d] -= push * delta[d];
+            x[D * j + d] += push * delta[d];
+            if (relVel > 0.0) {
+                v[D * i + d] -= relVel * delta[d] * (1 - ENTROPY);
+                v[D * j + d] += relVel * delta[d] * (1 - ENTROPY);
+            }
+        }
+    }
+
+    // Cells are coloured by their coordinates mod 3; a home cell and its half
+    // stencil stay within one cell of it, so cells of one colour run in parallel.
+    void collide(double *x, double *v) {
+        int colours = 1;
+        for (int d = 0; d < D; ++d) colours *= 3;
+        for (int colour = 0; colour < colours; ++colour) {
+            std::array<int, D> phase, count;
+            int rest = colour, members = 1;
+            for (int d = 0; d < D; ++d) {
+                phase[d] = rest % 3;
+                rest /= 3;
+                count[d] = (dims[d] - phase[d] + 2) / 3;
+                members *= count[d];
+            }
+            pool.parallelFor(members, [&](int start, int end) {
+                for (int m = start; m < end; ++m) {
+                    std::array<int, D> cell;
+                    int idx = m, home = 0;
+                    for (int d = 0; d < D; ++d) {
+                        cell[d] = phase[d] + 3 * (idx % count[d]);
+                        idx /= count[d];
+                        home += cell[d] * stride[d];
+                    }
+                    int homeStart = cellStart[home], homeEnd = cellStart[home + 1];
+                    for (int a = homeStart; a < homeEnd; ++a) {
+                        for (int b = a + 1; b < homeEnd; ++b) {
+                            resolvePair(x, v, cellParticles[a], cellParticles[b]);
+                        }
+                    }
+                    for (const auto &offset : halfStencil) {
+                        int other = 0;
+                        bool inside = true;
+                        for (int d = 0; d < D; ++d) {
+                            int k = cell[d] + offset[d];
+                            inside = inside && k >= 0 && k < dims[d];
+                            other += k * stride[d];
+                        }
+                        if (!inside) continue;
+                        for (int a = homeStart; a < homeEnd; ++a) {
+                            for (int b = cellStart[other]; b < cellStart[other + 1]; ++b) {
+                                resolvePair(x, v, cellParticles[a], cellParticles[b]);
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    std::array<float, D> box;
+    float radius;
+    ThreadPool &pool;
+
+    std::array<int, D> dims, stride;
+    std::array<float, D> cellSize;
+    std::vector<std::array<int, D>> halfStencil;
+
+    std::vector<int> cellStart, cellParticles, particleCell;
+};
+
+#endif // SPHERES_H
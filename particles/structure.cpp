@@ -0,0 +1,162 @@
+#include "structure.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+static const double PI = 3.14159265358979323846;
+
+PairStructure::PairStructure(float width, float height, float rMax, int bins, bool periodicX, bool periodicY, ThreadPool &pool)
+    : grid(width, height, rMax, periodicX, periodicY), pool(pool), rMax(rMax), bins(bins),
+      threadHistogram(pool.size(), std::vector<double>(bins, 0.0)), histogram(bins, 0.0)
+{
+}
+
+void PairStructure::reset() {
+    std::fill(histogram.begin(), histogram.end(), 0.0);
+    pairDensity = density = 0.0;
+    sampleCount = 0;
+}
+
+void PairStructure::merge(const PairStructure &other) {
+    for (int b = 0; b < bins; ++b) histogram[b] += other.histogram[b];
+    pairDensity += other.pairDensity;
+    density += other.density;
+    sampleCount += other.sampleCount;
+}
+
+void PairStructure::accumulate(const matrix &positions, const char *active) {
+    beginSample(positions, active);
+    runSlice(0, 1);
+    endSample();
+}
+
+void PairStructure::beginSample(const matrix &positions, const char *active) {
+    grid.build(positions);
+    // Copy the sample in cell order, so a cell's particles are a contiguous run
+    // and later changes to positions do not reach the slices still to come.
+    int n = positions.rows;
+    sortedX.resize(n);
+    sortedY.resize(n);
+    sortedActive.resize(n);
+    sampleParticles = 0.0;
+    for (int k = 0; k < n; ++k) {
+        int i = grid.cellParticles[k];
+        sortedX[k] = positions.data[2 * i + X];
+        sortedY[k] = positions.data[2 * i + Y];
+        sortedActive[k] = active ? active[i] : 1;
+        sampleParticles += sortedActive[k];
+    }
+
+    int cells = grid.nx * grid.ny;
+    pairsBefore.resize(cells + 1);
+    pairsBefore[0] = 0.0;
+    for (int c = 0; c < cells; ++c) {
+        int cx = c % grid.nx, cy = c / grid.nx;
+        double home = grid.cellStart[c + 1] - grid.cellStart[c];
+        double others = 0.0;
+        for (const auto &offset : HALF_STENCIL) {
+            int other = grid.neighbor(cx, cy, offset[0], offset[1]);
+            if (other >= 0) others += grid.cellStart[other + 1] - grid.cellStart[other];
+        }
+        pairsBefore[c + 1] = pairsBefore[c] + home * (0.5 * (home - 1.0) + others);
+    }
+}
+
+void PairStructure::runSlice(int slice, int slices) {
+    const double r2Max = static_cast<double>(rMax) * rMax;
+    const double scale = bins / static_cast<double>(rMax);
+    // Cut at the cells where the candidate pairs cross slice / slices of the total.
+    double total = pairsBefore.back();
+    auto cut = [&](int s) {
+        if (s >= slices) return static_cast<int>(pairsBefore.size()) - 1;
+        return static_cast<int>(std::lower_bound(pairsBefore.begin(), pairsBefore.end(), total * s / slices) - pairsBefore.begin());
+    };
+    int first = cut(slice), last = cut(slice + 1);
+    // Each thread bins into its own histogram, so home cells need no colouring.
+    pool.parallelFor(last - first, [&](int start, int end, unsigned thread) {
+        std::vector<double> &h = threadHistogram[thread];
+        // Pairs of run a with run b, whose positions are shifted by (sx, sy) to
+        // the periodic image next to a.
+        auto pairs = [&](int a0, int a1, int b0, int b1, double sx, double sy, bool same) {
+            for (int a = a0; a < a1; ++a) {
+                if (!sortedActive[a]) continue;
+                double xa = sortedX[a] - sx, ya = sortedY[a] - sy;
+                for (int b = same ? a + 1 : b0; b < b1; ++b) {
+                    double dx = sortedX[b] - xa;
+                    double dy = sortedY[b] - ya;
+                    double r2 = dx * dx + dy * dy;
+                    if (r2 >= r2Max || !sortedActive[b]) continue;
+                    h[std::min(bins - 1, static_cast<int>(std::sqrt(r2) * scale))] += 1.0;
+                }
+            }
+        };
+        for (int home = first + start; home < first + end; ++home) {
+            int cx = home % grid.nx, cy = home / grid.nx;
+            int homeStart = grid.cellStart[home], homeEnd = grid.cellStart[home + 1];
+            pairs(homeStart, homeEnd, homeStart, homeEnd, 0.0, 0.0, true);
+            for (const auto &offset : HALF_STENCIL) {
+                int other = grid.neighbor(cx, cy, offset[0], offset[1]);
+                if (other < 0) continue;
+                int ox = cx + offset[0], oy = cy + offset[1];
+                double sx = ox < 0 ? -grid.width : ox >= grid.nx ? grid.width : 0.0;
+                double sy = oy >= grid.ny ? grid.height : 0.0;
+                pairs(homeStart, homeEnd, grid.cellStart[other], grid.cellStart[other + 1], sx, sy, false);
+            }
+        }
+    });
+}
+
+void PairStructure::endSample() {
+    for (auto &h : threadHistogram) {
+        for (int b = 0; b < bins; ++b) {
+            histogram[b] += h[b];
+            h[b] = 0.0;
+        }
+    }
+    double area = static_cast<double>(grid.width) * grid.height;
+    pairDensity += 0.5 * sampleParticles * (sampleParticles - 1.0) / area;
+    density += sampleParticles / area;
+    sampleCount++;
+}
+
+std::vector<double> PairStructure::radii() const {
+    std::vector<double> r(bins);
+    double dr = rMax / static_cast<double>(bins);
+    for (int b = 0; b < bins; ++b) r[b] = (b + 0.5) * dr;
+    return r;
+}
+
+std::vector<double> PairStructure::rdf() const {
+    std::vector<double> g(bins, 0.0);
+    if (pairDensity <= 0.0) return g;
+    double dr = rMax / static_cast<double>(bins);
+    for (int b = 0; b < bins; ++b) {
+        double shell = PI * dr * dr * ((b + 1.0) * (b + 1.0) - static_cast<double>(b) * b);
+        g[b] = histogram[b] / (pairDensity * shell);
+    }
+    return g;
+}
+
+std::vector<double> PairStructure::structureFactor(const std::vector<double> &k) const {
+    std::vector<double> s(k.size(), 1.0);
+    structureFactor(k, 0, static_cast<int>(k.size()), s);
+    return s;
+}
+
+void PairStructure::structureFactor(const std::vector<double> &k, int first, int last, std::vector<double> &s) const {
+    if (sampleCount == 0) {
+        std::fill(s.begin() + first, s.begin() + last, 1.0);
+        return;
+    }
+    std::vector<double> g = rdf(), r = radii();
+    double rho = density / sampleCount;
+    double dr = rMax / static_cast<double>(bins);
+    for (int q = first; q < last; ++q) {
+        double sum = 0.0;
+        for (int b = 0; b < bins; ++b) sum += (g[b] - 1.0) * std::cyl_bessel_j(0.0, k[q] * r[b]) * 2.0 * PI * r[b] * dr;
+        s[q] = 1.0 + rho * sum;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef STRUCTURE_H
+#define STRUCTURE_H
+
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "threadpool.h"
+
+// Radial distribution function g(r) and static structure factor S(k), averaged
+// over samples. Pairs within rMax come from a cell grid with cells rMax wide and
+// are binned into a histogram per thread, summed when the sample ends.
+//
+// A sample can be split into slices, runs of home cells with about equal numbers
+// of candidate pairs, which may run at
+// different times (e.g. one per frame): beginSample() copies the positions, so
+// the slices all see the same instant while the simulation moves on.
+// accumulate() runs a whole sample at once.
+//
+// S(k) is the 2D transform of the averaged g(r),
+//   S(k) = 1 + rho int_0^rMax (g(r) - 1) J0(k r) 2 pi r dr,
+// so it is cut off below k ~ 2 pi / rMax. In a box with walls g(r) drops below
+// 1 at large r, since pairs near the walls lose partners beyond them.
+class PairStructure {
+public:
+    PairStructure(float width, float height, float rMax, int bins, bool periodicX, bool periodicY, ThreadPool &pool);
+
+    // One sample of the positions; active (optional) marks the rows to count.
+    void accumulate(const matrix &positions, const char *active = nullptr);
+
+    void beginSample(const matrix &positions, const char *active = nullptr);
+    // Pairs of slice s of slices parts of the cells; each part must run
+    // once between beginSample() and endSample().
+    void runSlice(int slice, int slices);
+    void endSample();
+
+    // Forget the samples so far.
+    void reset();
+    // Add the samples of another accumulator with the same rMax and bins.
+    void merge(const PairStructure &other);
+
+    int samples() const { return sampleCount; }
+
+    // Bin centres and g(r) there.
+    std::vector<double> radii() const;
+    std::vector<double> rdf() const;
+
+    // S(k) at each wavenumber, or at k[first, last) into s[first, last).
+    std::vector<double> structureFactor(const std::vector<double> &k) const;
+    void structureFactor(const std::vector<double> &k, int first, int last, std::vector<double> &s) const;
+
+private:
+    CellGrid grid;
+    ThreadPool &pool;
+    float rMax;
+    int bins;
+
+    // The sample being taken, in cell order.
+    std::vector<double> sortedX, sortedY;
+    std::vector<char> sortedActive;
+    std::vector<double> pairsBefore;   // candidate pairs of the home cells before each cell
+    double sampleParticles = 0.0;
+
+    std::vector<std::vector<double>> threadHistogram;
+    std::vector<double> histogram;
+    double pairDensity = 0.0;      // sum over samples of N (N - 1) / 2 / area
+    double density = 0.0;          // sum over samples of N / area
+    int sampleCount = 0;
+};
+
+#endif // STRUCTURE_H
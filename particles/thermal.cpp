@@ -0,0 +1,70 @@
+#include "thermal.h"
+
+#include <cmath>
+#include <cstdint>
+
+#define X 0
+#define Y 1
+
+HeatConduction::HeatConduction(int count, ThreadPool &pool)
+    : temperature(count, THERMAL_AMBIENT), count(count), flow(count, 0.0f), conduct(count, 0.0f),
+      contacts(pool.size()), pool(pool)
+{
+}
+
+void HeatConduction::addSource(float x0, float y0, float x1, float y1, float t, float rate) {
+    sources.push_back({ std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1), t, rate });
+}
+
+// Cold blue through red and yellow to white hot.
+sf::Color HeatConduction::colorOf(float t) const {
+    static const float stops[4][3] = { {60, 60, 160}, {220, 40, 20}, {255, 220, 40}, {255, 255, 255} };
+    float s = std::clamp((t - colorMin) / (colorMax - colorMin), 0.0f, 1.0f) * 3.0f;
+    int k = std::min(static_cast<int>(s), 2);
+    float f = s - k;
+    auto mix = [&](int c) { return static_cast<std::uint8_t>(stops[k][c] + f * (stops[k + 1][c] - stops[k][c])); };
+    return sf::Color(mix(0), mix(1), mix(2));
+}
+
+void HeatConduction::apply(const matrix &positions, matrix &accelerations, Particle **particles, double gravity) {
+    const double *x = positions.data.data();
+    double *a = accelerations.data.data();
+    // Each particle's limit on its contacts, as a factor on their conductances.
+    pool.parallelFor(count, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            float half = 0.5f * specificHeat * particles[i]->mass;
+            conduct[i] = conduct[i] > half ? half / conduct[i] : 1.0f;
+        }
+    });
+    // The buffers share particles, so their flows are added up in one pass.
+    for (auto &buffer : contacts) {
+        for (const Contact &c : buffer) {
+            float q = c.g * std::min(conduct[c.i], conduct[c.j]) * (temperature[c.j] - temperature[c.i]);
+            flow[c.i] += q;
+            flow[c.j] -= q;
+        }
+        buffer.clear();
+    }
+    pool.parallelFor(count, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            float capacity = specificHeat * particles[i]->mass;
+            float t = temperature[i] + flow[i] / capacity;
+            flow[i] = conduct[i] = 0.0f;
+            if (!particles[i]->active) continue;
+            float px = static_cast<float>(x[2 * i + X]), py = static_cast<float>(x[2 * i + Y]);
+            for (const Source &s : sources) {
+                if (px >= s.x0 && px <= s.x1 && py >= s.y0 && py <= s.y1) {
+                    t += (s.temperature - t) * (1.0f - std::exp(-s.rate * dt));
+                }
+            }
+            temperature[i] = t;
+            a[2 * i + Y] = gravity * (1.0 - buoyancy * (t - ambient));
+            particles[i]->shape.setFillColor(colorOf(t));
+        }
+    });
+}
+
+void HeatConduction::permute(const std::vector<int> &order) {
+    std::vector<float> old(temperature);
+    for (int k = 0; k < count; ++k) temperature[k] = old[order[k]];
+}
@@ -0,0 +1,73 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <vector>
+#include "matrix.h"
+#include "particle.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Heat conduction for the collision mode. Touching particles exchange heat in
+// proportion to their overlap and temperature difference; a particle's heat
+// capacity is its mass times the specific heat. The contact pass calls exchange()
+// for each touching pair next to the impulse, so conduction adds no traversal of
+// its own, and only records the contacts' conductances. apply() then runs the
+// flows and updates the temperatures in one pass over the particles, which also relaxes particles
+// inside the heat sources towards the source temperature, makes hot particles
+// buoyant and colours every particle by its temperature.
+class HeatConduction {
+public:
+    HeatConduction(int count, ThreadPool &pool);
+
+    std::vector<float> temperature;
+
+    float conductance = THERMAL_CONDUCTANCE;     // per pixel of overlap, per second
+    float specificHeat = THERMAL_SPECIFIC_HEAT;  // per unit mass
+    float ambient = THERMAL_AMBIENT;
+    float buoyancy = THERMAL_BUOYANCY;           // fraction of gravity lost per degree above ambient
+    float colorMin = THERMAL_COLD, colorMax = THERMAL_HOT;
+
+    // Hold the rectangle at a temperature, pulling particles inside towards it
+    // at rate (1/s).
+    void addSource(float x0, float y0, float x1, float y1, float temperature, float rate);
+
+    void begin(double dt) { this->dt = static_cast<float>(dt); }
+
+    // A contact of this step, for the caller holding the locks of i and j. Its
+    // flow waits for apply(), which needs every contact's conductance first.
+    void exchange(unsigned thread, int i, int j, float overlap) {
+        float g = conductance * overlap * dt;
+        contacts[thread].push_back({ i, j, g });
+        conduct[i] += g;
+        conduct[j] += g;
+    }
+
+    // Apply this step's flows and sources, buoyancy and colours. A particle
+    // whose contacts together conduct more than half its capacity per step
+    // limits them to that, which keeps the explicit update stable however many
+    // contacts a dense pile gives it. Each contact runs at the lower limit of
+    // its two particles, so conduction moves heat without making or losing any.
+    void apply(const matrix &positions, matrix &accelerations, Particle **particles, double gravity);
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k].
+    void permute(const std::vector<int> &order);
+
+    sf::Color colorOf(float t) const;
+
+private:
+    struct Source { float x0, y0, x1, y1, temperature, rate; };
+    struct Contact { int i, j; float g; };
+
+    int count;
+    float dt = 0.0f;
+    std::vector<float> flow;
+    std::vector<float> conduct;   // summed contact conductances of the step
+    std::vector<std::vector<Contact>> contacts;   // per thread
+    std::vector<Source> sources;
+    ThreadPool &pool;
+};
+
+#endif // THERMAL_H
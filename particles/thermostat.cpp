@@ -0,0 +1,28 @@
+#include "thermostat.h"
+
+#include <algorithm>
+
+Thermostat::Thermostat(Kind kind, double temperature, unsigned threads)
+    : kind(kind), temperature(temperature), threadKinetic(std::max(1u, threads), 0.0) {}
+
+void Thermostat::begin(double dt) {
+    std::fill(threadKinetic.begin(), threadKinetic.end(), 0.0);
+    decay = 1.0;
+    noise = 0.0;
+    scale = 1.0;
+    if (kind == LANGEVIN) {
+        decay = std::exp(-friction * dt);
+        noise = std::sqrt((1.0 - decay * decay) * temperature);
+    } else if (kind == BERENDSEN && measured > 0.0) {
+        // Clamped as in GROMACS so a cold start cannot blow the velocities up.
+        double lambda2 = 1.0 + dt / couplingTime * (temperature / measured - 1.0);
+        scale = std::clamp(std::sqrt(std::max(lambda2, 0.0)), 0.8, 1.25);
+    }
+}
+
+void Thermostat::end(int count) {
+    double kinetic = 0.0;
+    for (double k : threadKinetic) kinetic += k;
+    measured = count > 0 ? kinetic / count : 0.0;
+    step++;
+}
@@ -0,0 +1,88 @@
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "rng.h"
+#include "defs.h"
+
+// Temperature control applied inside an integrator's own per-particle loop
+// rather than as a sweep of its own. Temperatures are kT per particle (2D, so the
+// kinetic energy per particle is kT).
+//  - Langevin: v <- c1 v + c2 xi each step, c1 = exp(-friction dt),
+//    c2 = sqrt((1 - c1^2) kT / m), with xi drawn from the counter-based RNG by
+//    (particle, step) so the kicks are reproducible under any thread split.
+//  - Berendsen: v <- lambda v with lambda = sqrt(1 + dt/tau (T0/T - 1)), T being
+//    the temperature the previous step measured.
+// run() instantiates the integrator's loop once per kind, so the loop does not
+// branch on the kind, and draws the Langevin noise with gaussianBlock() a block
+// of particles ahead of the loop over them.
+class Thermostat {
+public:
+    enum Kind { NONE = THERMOSTAT_NONE, LANGEVIN = THERMOSTAT_LANGEVIN, BERENDSEN = THERMOSTAT_BERENDSEN };
+
+    Thermostat(Kind kind, double temperature, unsigned threads);
+
+    Kind kind;
+    double temperature;                        // target kT
+    double friction = THERMOSTAT_FRICTION;     // Langevin, 1/time
+    double couplingTime = THERMOSTAT_COUPLING; // Berendsen tau
+    std::uint64_t seed = THERMOSTAT_SEED;
+
+    // Work out this step's coefficients.
+    void begin(double dt);
+
+    // The integrator's loop over particles [start, end) with the thermostat in
+    // it: integrate(i) advances particle i and returns false to leave it out,
+    // mass(i) is its mass and v the (n x 2) velocities. Returns the kinetic
+    // energy of the particles after.
+    template <typename Integrate, typename Mass>
+    double run(int start, int end, double *v, Integrate &&integrate, Mass &&mass) const {
+        switch (kind) {
+        case LANGEVIN: return runAs<LANGEVIN>(start, end, v, integrate, mass);
+        case BERENDSEN: return runAs<BERENDSEN>(start, end, v, integrate, mass);
+        default: return runAs<NONE>(start, end, v, integrate, mass);
+        }
+    }
+
+    // Per-thread kinetic energy sums of the step, combined by end().
+    void addKinetic(unsigned thread, double kinetic) { threadKinetic[thread] += kinetic; }
+    void end(int count);
+
+    double measuredTemperature() const { return measured; }
+
+private:
+    template <Kind K, typename Integrate, typename Mass>
+    double runAs(int start, int end, double *v, Integrate &integrate, Mass &mass) const {
+        double kinetic = 0.0;
+        double g[2 * GAUSSIAN_BLOCK];
+        for (int first = start; first < end; first += GAUSSIAN_BLOCK) {
+            int last = std::min(end, first + GAUSSIAN_BLOCK);
+            if constexpr (K == LANGEVIN) gaussianBlock(seed, static_cast<std::uint64_t>(first), step, g);
+            for (int i = first; i < last; ++i) {
+                if (!integrate(i)) continue;
+                double m = mass(i);
+                double &vx = v[2 * i], &vy = v[2 * i + 1];
+                if constexpr (K == LANGEVIN) {
+                    double kick = noise / std::sqrt(m);
+                    vx = decay * vx + kick * g[2 * (i - first)];
+                    vy = decay * vy + kick * g[2 * (i - first) + 1];
+                } else if constexpr (K == BERENDSEN) {
+                    vx *= scale;
+                    vy *= scale;
+                }
+                kinetic += 0.5 * m * (vx * vx + vy * vy);
+            }
+        }
+        return kinetic;
+    }
+
+    std::uint64_t step = 0;
+    double decay = 1.0, noise = 0.0, scale = 1.0;
+    double measured = 0.0;
+    std::vector<double> threadKinetic;
+};
+
+#endif // THERMOSTAT_H
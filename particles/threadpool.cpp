@@ -0,0 +1,83 @@
+#include "threadpool.h"
+
+// Range handled by thread t when count items are split over n threads,
+// using the same "even share plus one extra" split as the cell partition in main.
+static void threadRange(int count, unsigned n, unsigned t, int &start, int &end) {
+    int share = count / static_cast<int>(n);
+    int extra = count % static_cast<int>(n);
+    int ti = static_cast<int>(t);
+    start = ti * share + (ti < extra ? ti : extra);
+    end = start + share + (ti < extra ? 1 : 0);
+}
+
+ThreadPool::ThreadPool(unsigned numThreads) : numThreads(numThreads == 0 ? 1 : numThreads) {
+    for (unsigned t = 1; t < this->numThreads; ++t) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &th : workers) {
+        th.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)>& fn) {
+    parallelFor(count, std::function<void(int, int, unsigned)>(
+        [&fn](int start, int end, unsigned) { fn(start, end); }));
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int, unsigned)>& fn) {
+    if (count <= 0) return;
+    if (numThreads == 1) {
+        fn(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        pending = numThreads - 1;
+        ++generation;
+    }
+    wake.notify_all();
+
+    int start, end;
+    threadRange(count, numThreads, 0, start, end);
+    if (start < end) fn(start, end, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned id) {
+    unsigned seen = 0;
+    while (true) {
+        const std::function<void(int, int, unsigned)>* task;
+        int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            task = job;
+            count = jobCount;
+        }
+
+        int start, end;
+        threadRange(count, numThreads, id, start, end);
+        if (start < end) (*task)(start, end, id);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for kernels that run many short parallel phases per
+// frame (e.g. one per solver iteration), where spawning threads each time would
+// cost more than the work itself.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return numThreads; }
+
+    // Split [0, count) into one contiguous range per thread and block until
+    // fn(start, end) has run on all of them. The calling thread takes the first range.
+    void parallelFor(int count, const std::function<void(int, int)>& fn);
+
+    // Same split, but fn also receives the index of the thread running the range
+    // so it can write into per-thread scratch buffers.
+    void parallelFor(int count, const std::function<void(int, int, unsigned)>& fn);
+
+private:
+    void workerLoop(unsigned id);
+
+    unsigned numThreads;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int, int, unsigned)>* job = nullptr;
+    int jobCount = 0;
+    unsigned generation = 0;
+    unsigned pending = 0;
+    bool stopping = false;
+};
+
+#endif // THREADPOOL_H
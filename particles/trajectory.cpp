@@ -0,0 +1,134 @@
+#include "trajectory.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char MAGIC[8] = "PTRJ1";
+
+std::size_t trajectoryFrameBytes(int particles) {
+    std::size_t n = static_cast<std::size_t>(particles);
+    std::size_t bytes = sizeof(TrajectoryFrameHeader) + 4 * n * sizeof(double) + 2 * n * sizeof(float) + n;
+    return (bytes + 7) & ~static_cast<std::size_t>(7);
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string &path, int particles, double width, double height, bool periodicX, bool periodicY)
+    : count(particles), storage(particles), identity(particles)
+{
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Cannot open trajectory file " + path);
+    }
+    for (int i = 0; i < count; ++i) storage[i] = identity[i] = i;
+
+    TrajectoryHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.particles = particles;
+    header.frameBytes = static_cast<std::int64_t>(trajectoryFrameBytes(particles));
+    header.width = width;
+    header.height = height;
+    header.periodicX = periodicX;
+    header.periodicY = periodicY;
+    write(&header, sizeof(header));
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    if (file) std::fclose(file);
+}
+
+void TrajectoryWriter::permute(const std::vector<int> &order) {
+    std::vector<int> old(identity);
+    for (int k = 0; k < count; ++k) {
+        identity[k] = old[order[k]];
+        storage[identity[k]] = k;
+    }
+}
+
+void TrajectoryWriter::write(const void *data, std::size_t bytes) {
+    if (std::fwrite(data, 1, bytes, file) != bytes) {
+        throw std::runtime_error("Cannot write trajectory file");
+    }
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &path) {
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot open trajectory file " + path);
+    }
+    fileHandle = f;
+    LARGE_INTEGER length;
+    GetFileSizeEx(f, &length);
+    size = static_cast<std::size_t>(length.QuadPart);
+    if (size >= sizeof(TrajectoryHeader)) {
+        mappingHandle = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle) base = static_cast<const char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open trajectory file " + path);
+    }
+    struct stat info;
+    fstat(fd, &info);
+    size = static_cast<std::size_t>(info.st_size);
+    if (size >= sizeof(TrajectoryHeader)) {
+        void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) base = static_cast<const char *>(p);
+    }
+#endif
+    if (!base || std::memcmp(header().magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header().frameBytes != static_cast<std::int64_t>(trajectoryFrameBytes(particles()))) {
+        release();
+        throw std::runtime_error("Not a trajectory file: " + path);
+    }
+    frameCount = static_cast<long>((size - sizeof(TrajectoryHeader)) / header().frameBytes);
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    release();
+}
+
+void TrajectoryReader::release() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+    mappingHandle = fileHandle = nullptr;
+#else
+    if (base) munmap(const_cast<char *>(base), size);
+    if (fd >= 0) close(fd);
+    fd = -1;
+#endif
+    base = nullptr;
+}
+
+TrajectoryFrame TrajectoryReader::frame(long f) const {
+    std::size_t n = static_cast<std::size_t>(particles());
+    const char *p = base + sizeof(TrajectoryHeader) + static_cast<std::size_t>(f) * header().frameBytes;
+    const TrajectoryFrameHeader *h = reinterpret_cast<const TrajectoryFrameHeader *>(p);
+    TrajectoryFrame frame;
+    frame.frame = static_cast<long>(h->frame);
+    frame.time = h->time;
+    p += sizeof(TrajectoryFrameHeader);
+    frame.positions = reinterpret_cast<const double *>(p);
+    p += 2 * n * sizeof(double);
+    frame.velocities = reinterpret_cast<const double *>(p);
+    p += 2 * n * sizeof(double);
+    frame.mass = reinterpret_cast<const float *>(p);
+    p += n * sizeof(float);
+    frame.radius = reinterpret_cast<const float *>(p);
+    p += n * sizeof(float);
+    frame.active = p;
+    return frame;
+}
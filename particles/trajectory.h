@@ -0,0 +1,112 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Recorded trajectories for offline analysis. Every frame has the same size, so
+// a reader maps the file and finds frame f at a fixed offset, with no parsing.
+// The file is a TrajectoryHeader, then per frame:
+//   TrajectoryFrameHeader
+//   positions, velocities   2 * particles native doubles each
+//   mass, radius            particles floats each
+//   active                  particles bytes, padded to 8
+// Rows are in particle identity order, not storage order, so row i is the same
+// particle in every frame however the simulation has reordered its storage.
+// A frame cut short by a crash is ignored by the reader.
+
+struct TrajectoryHeader {
+    char magic[8];              // "PTRJ1"
+    std::int64_t particles;
+    std::int64_t frameBytes;
+    double width, height;
+    std::int64_t periodicX, periodicY;
+    std::int64_t reserved;
+};
+static_assert(sizeof(TrajectoryHeader) == 64, "trajectory header is 64 bytes");
+
+struct TrajectoryFrameHeader {
+    std::int64_t frame;
+    double time;
+};
+
+// Bytes of one frame, header included.
+std::size_t trajectoryFrameBytes(int particles);
+
+// One frame of a mapped trajectory.
+struct TrajectoryFrame {
+    long frame;
+    double time;
+    const double *positions;    // x, y per particle
+    const double *velocities;
+    const float *mass;
+    const float *radius;
+    const char *active;
+};
+
+// Appends frames to a trajectory file. It follows the reorders of particle
+// storage like the other per-particle state, so frames can be written in
+// identity order; the frame itself is written by the caller, in pieces if it
+// likes, through write().
+class TrajectoryWriter {
+public:
+    // Creates path, replacing any file there; throws std::runtime_error if it
+    // cannot be opened.
+    TrajectoryWriter(const std::string &path, int particles, double width, double height, bool periodicX, bool periodicY);
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    int particles() const { return count; }
+
+    // Follow a reorder of the particle storage where new particle k is old
+    // particle order[k].
+    void permute(const std::vector<int> &order);
+    // Storage index of each particle, by identity.
+    const std::vector<int> &storageIndex() const { return storage; }
+
+    // Append bytes; throws std::runtime_error if the write fails.
+    void write(const void *data, std::size_t bytes);
+
+private:
+    int count;
+    std::FILE *file = nullptr;
+    std::vector<int> storage;
+    std::vector<int> identity;      // per storage index
+};
+
+// Maps a trajectory file read-only. Throws std::runtime_error if the file
+// cannot be opened or is not a trajectory.
+class TrajectoryReader {
+public:
+    explicit TrajectoryReader(const std::string &path);
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    const TrajectoryHeader &header() const { return *reinterpret_cast<const TrajectoryHeader *>(base); }
+    int particles() const { return static_cast<int>(header().particles); }
+    long frames() const { return frameCount; }
+
+    TrajectoryFrame frame(long f) const;
+
+private:
+    void release();
+
+    const char *base = nullptr;
+    std::size_t size = 0;
+    long frameCount = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,180 @@
+#include "xpbd.h"
+#include "cblas.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define X 0
+#define Y 1
+
+XpbdSolver::XpbdSolver(float width, float height, float radius, ThreadPool &pool)
+    : radius(radius), grid(width, height, 2.0f * radius * (1.0f + XPBD_CONTACT_MARGIN), false), pool(pool)
+{
+}
+
+void XpbdSolver::step(matrix &positions, matrix &velocities, double dt, double gravity) {
+    int n = positions.rows;
+    double *x = positions.data.data();
+    double *v = velocities.data.data();
+
+    // Contacts are found after each substep's predicted move, so a particle only
+    // has to move less than a radius per substep not to skip past another. Fast
+    // frames get extra substeps for that (up to XPBD_MAX_SUBSTEPS); particles
+    // faster still are not slowed down.
+    double fastest = std::abs(gravity) * dt;
+    if (n > 0) fastest += std::abs(v[cblas_idamax(2 * n, v, 1)]) * std::sqrt(2.0);
+    int count = std::max(substeps, static_cast<int>(std::ceil(fastest * dt / radius)));
+    count = std::min(count, XPBD_MAX_SUBSTEPS);
+    double h = dt / count;
+    double alphaTilde = compliance / (h * h);
+    double tolerance = XPBD_TOLERANCE * radius;
+    lastSubsteps = count;
+    substepCount += count;
+
+    for (int s = 0; s < count; ++s) {
+        previous = positions.data;
+        pool.parallelFor(n, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                v[2 * i + Y] += gravity * h;
+                x[2 * i + X] += v[2 * i + X] * h;
+                x[2 * i + Y] += v[2 * i + Y] * h;
+            }
+        });
+
+        // Back inside the walls first, so the sweeps do not push against a
+        // particle the wall will move. Then at least `iterations` sweeps, and more
+        // while a contact still overlaps by more than the tolerance, up to
+        // XPBD_MAX_ITERATIONS.
+        solveWalls(positions);
+        buildContacts(positions);
+        int it = 0;
+        while (it < XPBD_MAX_ITERATIONS) {
+            double worst = solveContacts(positions, alphaTilde);
+            solveWalls(positions);
+            ++it;
+            if (it >= iterations && worst <= tolerance) break;
+        }
+        iterationCount += it;
+
+        pool.parallelFor(n, [&](int start, int end) {
+            for (int i = start; i < end; ++i) {
+                v[2 * i + X] = (x[2 * i + X] - previous[2 * i + X]) / h;
+                v[2 * i + Y] = (x[2 * i + Y] - previous[2 * i + Y]) / h;
+            }
+        });
+    }
+    measure(positions);
+}
+
+void XpbdSolver::buildContacts(const matrix &positions) {
+    int n = positions.rows;
+    double reach = 2.0 * radius * (1.0 + XPBD_CONTACT_MARGIN);
+    double reach2 = reach * reach;
+    const double *x = positions.data.data();
+    grid.build(positions);
+
+    while (true) {
+        contactCount.assign(n, 0);
+        contacts.resize(static_cast<size_t>(n) * capacity);
+        forEachCellPair(grid, pool, [&](int i, int j, unsigned) {
+            double dx = x[2 * j + X] - x[2 * i + X];
+            double dy = x[2 * j + Y] - x[2 * i + Y];
+            if (dx * dx + dy * dy < reach2) {
+                int k = contactCount[i]++;
+                if (k < capacity) contacts[static_cast<size_t>(i) * capacity + k] = j;
+            }
+        });
+        int most = n > 0 ? *std::max_element(contactCount.begin(), contactCount.end()) : 0;
+        if (most <= capacity) break;
+        capacity = most + most / 4 + 1;
+    }
+    lambdas.assign(contacts.size(), 0.0);
+}
+
+double XpbdSolver::solveContacts(matrix &positions, double alphaTilde) {
+    double *x = positions.data.data();
+    double rest = 2.0 * radius;
+    threadCount.assign(pool.size(), 0);
+    threadWorst.assign(pool.size(), 0.0);
+
+    for (int colorY = 0; colorY < 2; ++colorY) {
+        for (int colorX = 0; colorX < 3; ++colorX) {
+            forEachCellOfColor(grid, pool, colorX, colorY, [&](int cx, int cy, unsigned thread) {
+                int home = cy * grid.nx + cx;
+                for (int a = grid.cellStart[home]; a < grid.cellStart[home + 1]; ++a) {
+                    int i = grid.cellParticles[a];
+                    size_t row = static_cast<size_t>(i) * capacity;
+                    for (int k = 0; k < contactCount[i]; ++k) {
+                        int j = contacts[row + k];
+                        double dx = x[2 * j + X] - x[2 * i + X];
+                        double dy = x[2 * j + Y] - x[2 * i + Y];
+                        double d = std::sqrt(dx * dx + dy * dy);
+                        if (d == 0.0) continue;
+                        double c = d - rest;
+                        // The multiplier summed over the sweeps stays >= 0: a contact
+                        // only pushes, and a pair pushed apart further than it needed
+                        // gives the excess back.
+                        double &lambda = lambdas[row + k];
+                        double dLambda = std::max((-c - alphaTilde * lambda) / (2.0 + alphaTilde), -lambda);
+                        if (dLambda == 0.0) continue;
+                        lambda += dLambda;
+                        double nx = dx / d, ny = dy / d;
+                        x[2 * i + X] -= dLambda * nx;
+                        x[2 * i + Y] -= dLambda * ny;
+                        x[2 * j + X] += dLambda * nx;
+                        x[2 * j + Y] += dLambda * ny;
+                        threadCount[thread]++;
+                        threadWorst[thread] = std::max(threadWorst[thread], -c);
+                    }
+                }
+            });
+        }
+    }
+    for (long long count : threadCount) solves += count;
+    return *std::max_element(threadWorst.begin(), threadWorst.end());
+}
+
+void XpbdSolver::solveWalls(matrix &positions) {
+    double *x = positions.data.data();
+    double maxX = grid.width - radius, maxY = grid.height - radius;
+    pool.parallelFor(positions.rows, [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            x[2 * i + X] = std::clamp(x[2 * i + X], static_cast<double>(radius), maxX);
+            x[2 * i + Y] = std::clamp(x[2 * i + Y], static_cast<double>(radius), maxY);
+        }
+    });
+}
+
+void XpbdSolver::measure(const matrix &positions) {
+    const double *x = positions.data.data();
+    double rest = 2.0 * radius;
+    threadWorst.assign(pool.size(), 0.0);
+    threadSum.assign(pool.size(), 0.0);
+    threadCount.assign(pool.size(), 0);
+
+    pool.parallelFor(positions.rows, [&](int start, int end, unsigned thread) {
+        for (int i = start; i < end; ++i) {
+            size_t row = static_cast<size_t>(i) * capacity;
+            for (int k = 0; k < contactCount[i]; ++k) {
+                int j = contacts[row + k];
+                double dx = x[2 * j + X] - x[2 * i + X];
+                double dy = x[2 * j + Y] - x[2 * i + Y];
+                double overlap = rest - std::sqrt(dx * dx + dy * dy);
+                if (overlap <= 0.0) continue;
+                threadWorst[thread] = std::max(threadWorst[thread], overlap);
+                threadSum[thread] += overlap;
+                threadCount[thread]++;
+            }
+        }
+    });
+
+    maxOverlap = 0.0;
+    double sum = 0.0;
+    long long count = 0;
+    for (unsigned t = 0; t < pool.size(); ++t) {
+        maxOverlap = std::max(maxOverlap, threadWorst[t]);
+        sum += threadSum[t];
+        count += threadCount[t];
+    }
+    meanOverlap = count > 0 ? sum / count : 0.0;
+}
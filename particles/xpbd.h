@@ -0,0 +1,68 @@
+#ifndef XPBD_H
+#define XPBD_H
+
+#include <vector>
+#include "matrix.h"
+#include "grid.h"
+#include "threadpool.h"
+#include "defs.h"
+
+// Position-based contact solver (XPBD). Contacts are compliant inequality
+// constraints C = |xj - xi| - (ri + rj) >= 0 solved on predicted positions, so
+// penetration is actually removed rather than only reflected in the velocity.
+// Iterations are Gauss-Seidel within a cell and parallel across cells of the same
+// colour (see forEachCellOfColor), which keeps stacks stiff at the frame timestep.
+class XpbdSolver {
+public:
+    XpbdSolver(float width, float height, float radius, ThreadPool &pool);
+
+    int substeps = XPBD_SUBSTEPS;
+    // Sweeps per substep; more run, up to XPBD_MAX_ITERATIONS, while a contact
+    // overlaps by more than XPBD_TOLERANCE radii.
+    int iterations = XPBD_ITERATIONS;
+    double compliance = XPBD_COMPLIANCE;
+
+    // Advance by dt under gravity, split into at least `substeps` substeps.
+    void step(matrix &positions, matrix &velocities, double dt, double gravity);
+
+    // Largest and mean overlap among the contacts of the last substep.
+    double maxPenetration() const { return maxOverlap; }
+    double meanPenetration() const { return meanOverlap; }
+    long long constraintSolves() const { return solves; }
+    int substepsUsed() const { return lastSubsteps; }
+    long long substepsRun() const { return substepCount; }
+    long long iterationsRun() const { return iterationCount; }
+
+private:
+    void buildContacts(const matrix &positions);
+    // One sweep over the contacts; returns the largest overlap it corrected.
+    double solveContacts(matrix &positions, double alphaTilde);
+    void solveWalls(matrix &positions);
+    void measure(const matrix &positions);
+
+    float radius;
+    CellGrid grid;
+    ThreadPool &pool;
+
+    // Candidate contacts in fixed-capacity rows owned by the home-cell particle,
+    // with the accumulated multiplier of each.
+    int capacity = 8;
+    std::vector<int> contactCount;
+    std::vector<int> contacts;
+    std::vector<double> lambdas;
+    std::vector<double> previous;
+
+    // Per-thread largest overlap, overlap sum and count of a sweep or measure().
+    std::vector<double> threadWorst;
+    std::vector<double> threadSum;
+    std::vector<long long> threadCount;
+
+    double maxOverlap = 0.0;
+    double meanOverlap = 0.0;
+    long long solves = 0;
+    int lastSubsteps = 0;
+    long long substepCount = 0;
+    long long iterationCount = 0;
+};
+
+#endif // XPBD_H